@@ -0,0 +1,1219 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_ArtOrderedMap_H
+#define Foundation42_ArtOrderedMap_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Template struct that turns a key into bytes whose lexicographic order
+// matches the key's order. Integers are stored big-endian with the sign bit
+// flipped; strings are used as they are.
+template <typename Key_t, typename Enable_t = void>
+struct ArtKeyTraits;
+
+template <typename Key_t>
+struct ArtKeyTraits<Key_t, typename std::enable_if<std::is_integral<Key_t>::value>::type>
+{
+    static std::string Encode(const Key_t& key)
+    {
+        using Unsigned_t = typename std::make_unsigned<Key_t>::type;
+
+        auto bits { static_cast<Unsigned_t>(key) };
+        if (std::is_signed<Key_t>::value)
+            bits ^= Unsigned_t { 1 } << (sizeof(Key_t) * CHAR_BIT - 1);
+
+        std::string bytes(sizeof(Key_t), '\0');
+
+        for (auto i = sizeof(Key_t); i > 0; i--)
+        {
+            bytes[i - 1] = static_cast<char>(bits & 0xFF);
+            bits = static_cast<Unsigned_t>(bits >> 8);
+        }
+
+        return bytes;
+    }
+};
+
+template <>
+struct ArtKeyTraits<std::string>
+{
+    static std::string Encode(const std::string& key)
+    {
+        return key;
+    }
+};
+
+// Template class for an ordered map built on an adaptive radix tree (ART).
+// Lookups cost O(key length) regardless of the number of entries, keys are
+// visited in sorted order, and inner nodes grow through 4, 16, 48 and 256
+// children so sparse levels stay small. Shared key prefixes are collapsed
+// into the node that owns them; only the first MaxPrefix bytes are kept and
+// the rest are checked against a leaf.
+template <typename Key_t, typename Value_t, typename Traits_t = ArtKeyTraits<Key_t>>
+class ArtOrderedMap
+{
+private:
+    static constexpr std::uint32_t MaxPrefix { 8 }; // Prefix bytes stored in a node.
+
+    // Kinds of inner node.
+    enum class NodeType : std::uint8_t
+    {
+        Node4,
+        Node16,
+        Node48,
+        Node256
+    };
+
+    // Structure for a leaf, holding one entry.
+    struct Leaf
+    {
+        Key_t Key;
+        Value_t Value;
+    };
+
+    // Structure for the part shared by every inner node.
+    struct Node
+    {
+        NodeType Type;
+        std::uint16_t Count { 0 }; // Number of children.
+        std::uint32_t PrefixLength { 0 }; // Length of the collapsed prefix.
+        std::uint8_t Prefix[MaxPrefix] {}; // First bytes of the collapsed prefix.
+        Leaf* Terminal { nullptr }; // Entry whose key ends at this node.
+
+        explicit Node(NodeType type) :
+            Type(type)
+        {
+        }
+    };
+
+    // Children are tagged pointers: the low bit is set for a leaf.
+    using Ref = std::uintptr_t;
+
+    struct Node4 : Node
+    {
+        std::uint8_t Keys[4] {};
+        Ref Children[4] {};
+
+        Node4() : Node(NodeType::Node4) {}
+    };
+
+    struct Node16 : Node
+    {
+        std::uint8_t Keys[16] {};
+        Ref Children[16] {};
+
+        Node16() : Node(NodeType::Node16) {}
+    };
+
+    struct Node48 : Node
+    {
+        std::uint8_t Slots[256] {}; // Slot + 1 for each byte, or zero.
+        Ref Children[48] {};
+
+        Node48() : Node(NodeType::Node48) {}
+    };
+
+    struct Node256 : Node
+    {
+        Ref Children[256] {};
+
+        Node256() : Node(NodeType::Node256) {}
+    };
+
+    Ref Root { 0 }; // Root of the tree.
+    std::size_t ItemCount { 0 }; // Number of items in the map.
+
+    static bool IsLeaf(Ref ref)
+    {
+        return (ref & 1) != 0;
+    }
+
+    static Leaf* AsLeaf(Ref ref)
+    {
+        return reinterpret_cast<Leaf*>(ref & ~Ref { 1 });
+    }
+
+    static Node* AsNode(Ref ref)
+    {
+        return reinterpret_cast<Node*>(ref);
+    }
+
+    static Ref LeafRef(Leaf* leaf)
+    {
+        return reinterpret_cast<Ref>(leaf) | 1;
+    }
+
+    static Ref NodeRef(Node* node)
+    {
+        return reinterpret_cast<Ref>(node);
+    }
+
+    // Find the slot holding the child for the given byte, or nullptr.
+    static Ref* FindChild(Node* node, std::uint8_t byte)
+    {
+        switch (node->Type)
+        {
+        case NodeType::Node4:
+        {
+            auto n { static_cast<Node4*>(node) };
+
+            for (auto i = 0; i < n->Count; i++)
+            {
+                if (n->Keys[i] == byte)
+                    return &n->Children[i];
+            }
+
+            return nullptr;
+        }
+        case NodeType::Node16:
+        {
+            auto n { static_cast<Node16*>(node) };
+
+#if defined(__SSE2__)
+            // Compare all sixteen keys at once.
+            auto matches { _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(byte)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(n->Keys))) };
+            auto mask { _mm_movemask_epi8(matches) & ((1 << n->Count) - 1) };
+
+            if (mask != 0)
+                return &n->Children[__builtin_ctz(static_cast<unsigned>(mask))];
+#else
+            for (auto i = 0; i < n->Count; i++)
+            {
+                if (n->Keys[i] == byte)
+                    return &n->Children[i];
+            }
+#endif
+
+            return nullptr;
+        }
+        case NodeType::Node48:
+        {
+            auto n { static_cast<Node48*>(node) };
+
+            if (n->Slots[byte] == 0)
+                return nullptr;
+
+            return &n->Children[n->Slots[byte] - 1];
+        }
+        case NodeType::Node256:
+        {
+            auto n { static_cast<Node256*>(node) };
+
+            if (n->Children[byte] == 0)
+                return nullptr;
+
+            return &n->Children[byte];
+        }
+        }
+
+        return nullptr;
+    }
+
+    // Copy the shared header from one node to its replacement.
+    static void CopyHeader(Node* to, const Node* from)
+    {
+        to->Count = from->Count;
+        to->PrefixLength = from->PrefixLength;
+        std::memcpy(to->Prefix, from->Prefix, MaxPrefix);
+        to->Terminal = from->Terminal;
+    }
+
+    // Add a child for the given byte, growing the node if it is full.
+    // The reference to the node is updated if it is replaced.
+    static void AddChild(Ref& ref, std::uint8_t byte, Ref child)
+    {
+        auto node { AsNode(ref) };
+
+        switch (node->Type)
+        {
+        case NodeType::Node4:
+        {
+            auto n { static_cast<Node4*>(node) };
+
+            if (n->Count < 4)
+            {
+                // Keep the keys sorted.
+                auto i { 0 };
+                while (i < n->Count && n->Keys[i] < byte)
+                    i++;
+
+                std::memmove(n->Keys + i + 1, n->Keys + i, n->Count - i);
+                std::memmove(n->Children + i + 1, n->Children + i, (n->Count - i) * sizeof(Ref));
+                n->Keys[i] = byte;
+                n->Children[i] = child;
+                n->Count++;
+                return;
+            }
+
+            auto bigger { new Node16() };
+            CopyHeader(bigger, n);
+            std::memcpy(bigger->Keys, n->Keys, 4);
+            std::memcpy(bigger->Children, n->Children, 4 * sizeof(Ref));
+            delete n;
+
+            ref = NodeRef(bigger);
+            AddChild(ref, byte, child);
+            return;
+        }
+        case NodeType::Node16:
+        {
+            auto n { static_cast<Node16*>(node) };
+
+            if (n->Count < 16)
+            {
+                // Keep the keys sorted.
+                auto i { 0 };
+                while (i < n->Count && n->Keys[i] < byte)
+                    i++;
+
+                std::memmove(n->Keys + i + 1, n->Keys + i, n->Count - i);
+                std::memmove(n->Children + i + 1, n->Children + i, (n->Count - i) * sizeof(Ref));
+                n->Keys[i] = byte;
+                n->Children[i] = child;
+                n->Count++;
+                return;
+            }
+
+            auto bigger { new Node48() };
+            CopyHeader(bigger, n);
+
+            for (auto i = 0; i < 16; i++)
+            {
+                bigger->Children[i] = n->Children[i];
+                bigger->Slots[n->Keys[i]] = static_cast<std::uint8_t>(i + 1);
+            }
+
+            delete n;
+
+            ref = NodeRef(bigger);
+            AddChild(ref, byte, child);
+            return;
+        }
+        case NodeType::Node48:
+        {
+            auto n { static_cast<Node48*>(node) };
+
+            if (n->Count < 48)
+            {
+                // Take the first free slot.
+                auto slot { 0 };
+                while (n->Children[slot] != 0)
+                    slot++;
+
+                n->Children[slot] = child;
+                n->Slots[byte] = static_cast<std::uint8_t>(slot + 1);
+                n->Count++;
+                return;
+            }
+
+            auto bigger { new Node256() };
+            CopyHeader(bigger, n);
+
+            for (auto i = 0; i < 256; i++)
+            {
+                if (n->Slots[i] != 0)
+                    bigger->Children[i] = n->Children[n->Slots[i] - 1];
+            }
+
+            delete n;
+
+            ref = NodeRef(bigger);
+            AddChild(ref, byte, child);
+            return;
+        }
+        case NodeType::Node256:
+        {
+            auto n { static_cast<Node256*>(node) };
+
+            n->Children[byte] = child;
+            n->Count++;
+            return;
+        }
+        }
+    }
+
+    // Using declaration for a function that takes a child in byte order.
+    using childCallback = std::function<bool (std::uint8_t byte, Ref child)>;
+
+    // Apply the given function to each child of the node in byte order,
+    // stopping if it returns false. Returns false if it was stopped.
+    static bool ForEachChild(const Node* node, const childCallback& callback)
+    {
+        switch (node->Type)
+        {
+        case NodeType::Node4:
+        {
+            auto n { static_cast<const Node4*>(node) };
+
+            for (auto i = 0; i < n->Count; i++)
+            {
+                if (!callback(n->Keys[i], n->Children[i]))
+                    return false;
+            }
+
+            return true;
+        }
+        case NodeType::Node16:
+        {
+            auto n { static_cast<const Node16*>(node) };
+
+            for (auto i = 0; i < n->Count; i++)
+            {
+                if (!callback(n->Keys[i], n->Children[i]))
+                    return false;
+            }
+
+            return true;
+        }
+        case NodeType::Node48:
+        {
+            auto n { static_cast<const Node48*>(node) };
+
+            for (auto i = 0; i < 256; i++)
+            {
+                if (n->Slots[i] != 0 && !callback(static_cast<std::uint8_t>(i), n->Children[n->Slots[i] - 1]))
+                    return false;
+            }
+
+            return true;
+        }
+        case NodeType::Node256:
+        {
+            auto n { static_cast<const Node256*>(node) };
+
+            for (auto i = 0; i < 256; i++)
+            {
+                if (n->Children[i] != 0 && !callback(static_cast<std::uint8_t>(i), n->Children[i]))
+                    return false;
+            }
+
+            return true;
+        }
+        }
+
+        return true;
+    }
+
+    // Get the leaf with the smallest key below the given reference.
+    static Leaf* MinimumLeaf(Ref ref)
+    {
+        while (!IsLeaf(ref))
+        {
+            auto node { AsNode(ref) };
+
+            // A key ending here is a prefix of, and so sorts before, every other.
+            if (node->Terminal != nullptr)
+                return node->Terminal;
+
+            Ref first { 0 };
+
+            ForEachChild(node, [&first](std::uint8_t, Ref child)
+            {
+                first = child;
+                return false;
+            });
+
+            ref = first;
+        }
+
+        return AsLeaf(ref);
+    }
+
+    // Get the number of leading bytes of the node's prefix that match the
+    // key from the given depth. Bytes past the stored ones come from a leaf.
+    static std::uint32_t PrefixMismatch(Node* node, const std::string& bytes, std::size_t depth)
+    {
+        auto remaining { static_cast<std::uint32_t>(bytes.size() - depth) };
+        auto stored { std::min({ node->PrefixLength, MaxPrefix, remaining }) };
+        std::uint32_t i { 0 };
+
+        for (; i < stored; i++)
+        {
+            if (node->Prefix[i] != static_cast<std::uint8_t>(bytes[depth + i]))
+                return i;
+        }
+
+        if (node->PrefixLength > MaxPrefix)
+        {
+            auto leafBytes { Traits_t::Encode(MinimumLeaf(NodeRef(node))->Key) };
+            auto limit { std::min({ node->PrefixLength, remaining,
+                                    static_cast<std::uint32_t>(leafBytes.size() - depth) }) };
+
+            for (; i < limit; i++)
+            {
+                if (leafBytes[depth + i] != bytes[depth + i])
+                    return i;
+            }
+        }
+
+        return i;
+    }
+
+    // Set the node's prefix from the given bytes.
+    static void SetPrefix(Node* node, const char* bytes, std::uint32_t length)
+    {
+        node->PrefixLength = length;
+        std::memcpy(node->Prefix, bytes, std::min(length, MaxPrefix));
+    }
+
+    // Insert the given pair below the reference, which is updated if the
+    // node it points at is replaced. Returns the leaf holding the key.
+    Leaf* Insert(Ref& ref, const std::string& bytes, std::size_t depth, const Key_t& key, const Value_t& value)
+    {
+        // An empty slot takes the new leaf directly.
+        if (ref == 0)
+        {
+            auto leaf { new Leaf { key, value } };
+            ref = LeafRef(leaf);
+            this->ItemCount++;
+            return leaf;
+        }
+
+        // A leaf either is the key, or must be split into a node holding both.
+        if (IsLeaf(ref))
+        {
+            auto existing { AsLeaf(ref) };
+            auto existingBytes { Traits_t::Encode(existing->Key) };
+
+            if (existingBytes == bytes)
+                return existing;
+
+            auto common { depth };
+            while (common < bytes.size() && common < existingBytes.size() && bytes[common] == existingBytes[common])
+                common++;
+
+            auto node { new Node4() };
+            SetPrefix(node, bytes.data() + depth, static_cast<std::uint32_t>(common - depth));
+
+            auto leaf { new Leaf { key, value } };
+            auto nodeRef { NodeRef(node) };
+
+            if (common == existingBytes.size())
+                node->Terminal = existing;
+            else
+                AddChild(nodeRef, static_cast<std::uint8_t>(existingBytes[common]), ref);
+
+            if (common == bytes.size())
+                node->Terminal = leaf;
+            else
+                AddChild(nodeRef, static_cast<std::uint8_t>(bytes[common]), LeafRef(leaf));
+
+            ref = nodeRef;
+            this->ItemCount++;
+            return leaf;
+        }
+
+        auto node { AsNode(ref) };
+
+        // Split the node if the key leaves its prefix part-way through.
+        if (node->PrefixLength > 0)
+        {
+            auto mismatch { PrefixMismatch(node, bytes, depth) };
+
+            if (mismatch < node->PrefixLength)
+            {
+                auto parent { new Node4() };
+                auto parentRef { NodeRef(parent) };
+
+                // The full prefix may be longer than what the node stores.
+                std::string fullPrefix;
+                if (node->PrefixLength <= MaxPrefix)
+                    fullPrefix.assign(reinterpret_cast<const char*>(node->Prefix), node->PrefixLength);
+                else
+                    fullPrefix = Traits_t::Encode(MinimumLeaf(ref)->Key).substr(depth, node->PrefixLength);
+
+                SetPrefix(parent, fullPrefix.data(), mismatch);
+
+                auto branchByte { static_cast<std::uint8_t>(fullPrefix[mismatch]) };
+                SetPrefix(node, fullPrefix.data() + mismatch + 1, node->PrefixLength - mismatch - 1);
+                AddChild(parentRef, branchByte, ref);
+
+                auto leaf { new Leaf { key, value } };
+
+                if (depth + mismatch == bytes.size())
+                    parent->Terminal = leaf;
+                else
+                    AddChild(parentRef, static_cast<std::uint8_t>(bytes[depth + mismatch]), LeafRef(leaf));
+
+                ref = parentRef;
+                this->ItemCount++;
+                return leaf;
+            }
+
+            depth += node->PrefixLength;
+        }
+
+        // The key ends at this node.
+        if (depth == bytes.size())
+        {
+            if (node->Terminal != nullptr)
+                return node->Terminal;
+
+            node->Terminal = new Leaf { key, value };
+            this->ItemCount++;
+            return node->Terminal;
+        }
+
+        auto byte { static_cast<std::uint8_t>(bytes[depth]) };
+        auto child { FindChild(node, byte) };
+
+        if (child != nullptr)
+            return this->Insert(*child, bytes, depth + 1, key, value);
+
+        auto leaf { new Leaf { key, value } };
+        AddChild(ref, byte, LeafRef(leaf));
+        this->ItemCount++;
+        return leaf;
+    }
+
+    // Find the leaf with the given key, or nullptr.
+    Leaf* Search(const std::string& bytes) const
+    {
+        auto ref { this->Root };
+        std::size_t depth { 0 };
+
+        while (ref != 0)
+        {
+            if (IsLeaf(ref))
+            {
+                auto leaf { AsLeaf(ref) };
+                return Traits_t::Encode(leaf->Key) == bytes ? leaf : nullptr;
+            }
+
+            auto node { AsNode(ref) };
+
+            // Check the stored prefix bytes; the rest are checked at the leaf.
+            if (node->PrefixLength > 0)
+            {
+                if (depth + node->PrefixLength > bytes.size())
+                    return nullptr;
+
+                auto stored { std::min(node->PrefixLength, MaxPrefix) };
+
+                for (std::uint32_t i = 0; i < stored; i++)
+                {
+                    if (node->Prefix[i] != static_cast<std::uint8_t>(bytes[depth + i]))
+                        return nullptr;
+                }
+
+                depth += node->PrefixLength;
+            }
+
+            if (depth == bytes.size())
+            {
+                auto leaf { node->Terminal };
+
+                if (leaf != nullptr && Traits_t::Encode(leaf->Key) == bytes)
+                    return leaf;
+
+                return nullptr;
+            }
+
+            auto child { FindChild(node, static_cast<std::uint8_t>(bytes[depth])) };
+            if (child == nullptr)
+                return nullptr;
+
+            ref = *child;
+            depth++;
+        }
+
+        return nullptr;
+    }
+
+    // Free everything below the given reference.
+    static void Destroy(Ref ref)
+    {
+        if (ref == 0)
+            return;
+
+        if (IsLeaf(ref))
+        {
+            delete AsLeaf(ref);
+            return;
+        }
+
+        auto node { AsNode(ref) };
+        delete node->Terminal;
+
+        ForEachChild(node, [](std::uint8_t, Ref child)
+        {
+            Destroy(child);
+            return true;
+        });
+
+        FreeNode(node);
+    }
+
+    // Free a single inner node, leaving its children alone.
+    static void FreeNode(Node* node)
+    {
+        switch (node->Type)
+        {
+        case NodeType::Node4:
+            delete static_cast<Node4*>(node);
+            break;
+        case NodeType::Node16:
+            delete static_cast<Node16*>(node);
+            break;
+        case NodeType::Node48:
+            delete static_cast<Node48*>(node);
+            break;
+        case NodeType::Node256:
+            delete static_cast<Node256*>(node);
+            break;
+        }
+    }
+
+    // Remove the child for the given byte from the node.
+    static void RemoveChild(Node* node, std::uint8_t byte)
+    {
+        switch (node->Type)
+        {
+        case NodeType::Node4:
+        case NodeType::Node16:
+        {
+            // Both keep sorted keys followed by their children.
+            auto keys { node->Type == NodeType::Node4 ? static_cast<Node4*>(node)->Keys : static_cast<Node16*>(node)->Keys };
+            auto children { node->Type == NodeType::Node4 ? static_cast<Node4*>(node)->Children : static_cast<Node16*>(node)->Children };
+
+            auto i { 0 };
+            while (keys[i] != byte)
+                i++;
+
+            std::memmove(keys + i, keys + i + 1, node->Count - i - 1);
+            std::memmove(children + i, children + i + 1, (node->Count - i - 1) * sizeof(Ref));
+            break;
+        }
+        case NodeType::Node48:
+        {
+            auto n { static_cast<Node48*>(node) };
+
+            n->Children[n->Slots[byte] - 1] = 0;
+            n->Slots[byte] = 0;
+            break;
+        }
+        case NodeType::Node256:
+        {
+            static_cast<Node256*>(node)->Children[byte] = 0;
+            break;
+        }
+        }
+
+        node->Count--;
+    }
+
+    // Shrink the node after a removal: drop it if it has one entry left,
+    // or move it down to a smaller node type once it is sparse enough.
+    // The node's prefix starts at the given depth. The reference to the
+    // node is updated if it is replaced.
+    static void Shrink(Ref& ref, std::size_t depth)
+    {
+        auto node { AsNode(ref) };
+
+        // Only a terminal entry left: the leaf takes the node's place.
+        if (node->Count == 0)
+        {
+            ref = node->Terminal != nullptr ? LeafRef(node->Terminal) : 0;
+            FreeNode(node);
+            return;
+        }
+
+        // A single child left: merge this node's prefix into it.
+        if (node->Count == 1 && node->Terminal == nullptr)
+        {
+            Ref child { 0 };
+
+            ForEachChild(node, [&child](std::uint8_t, Ref only)
+            {
+                child = only;
+                return false;
+            });
+
+            // The child's new prefix is this node's, its byte, then its own.
+            if (!IsLeaf(child))
+            {
+                auto inner { AsNode(child) };
+                auto bytes { Traits_t::Encode(MinimumLeaf(child)->Key) };
+                SetPrefix(inner, bytes.data() + depth, node->PrefixLength + 1 + inner->PrefixLength);
+            }
+
+            ref = child;
+            FreeNode(node);
+            return;
+        }
+
+        switch (node->Type)
+        {
+        case NodeType::Node4:
+            return;
+        case NodeType::Node16:
+        {
+            if (node->Count > 3)
+                return;
+
+            auto n { static_cast<Node16*>(node) };
+            auto smaller { new Node4() };
+            CopyHeader(smaller, n);
+            std::memcpy(smaller->Keys, n->Keys, n->Count);
+            std::memcpy(smaller->Children, n->Children, n->Count * sizeof(Ref));
+
+            ref = NodeRef(smaller);
+            break;
+        }
+        case NodeType::Node48:
+        {
+            if (node->Count > 12)
+                return;
+
+            auto n { static_cast<Node48*>(node) };
+            auto smaller { new Node16() };
+            CopyHeader(smaller, n);
+
+            auto count { 0 };
+            for (auto i = 0; i < 256; i++)
+            {
+                if (n->Slots[i] == 0)
+                    continue;
+
+                smaller->Keys[count] = static_cast<std::uint8_t>(i);
+                smaller->Children[count] = n->Children[n->Slots[i] - 1];
+                count++;
+            }
+
+            ref = NodeRef(smaller);
+            break;
+        }
+        case NodeType::Node256:
+        {
+            if (node->Count > 37)
+                return;
+
+            auto n { static_cast<Node256*>(node) };
+            auto smaller { new Node48() };
+            CopyHeader(smaller, n);
+
+            auto count { 0 };
+            for (auto i = 0; i < 256; i++)
+            {
+                if (n->Children[i] == 0)
+                    continue;
+
+                smaller->Children[count] = n->Children[i];
+                smaller->Slots[i] = static_cast<std::uint8_t>(count + 1);
+                count++;
+            }
+
+            ref = NodeRef(smaller);
+            break;
+        }
+        }
+
+        FreeNode(node);
+    }
+
+    // Remove the given key from below the reference, which is updated if
+    // the node it points at is replaced. Returns true if it was present.
+    bool Remove(Ref& ref, const std::string& bytes, std::size_t depth)
+    {
+        if (ref == 0)
+            return false;
+
+        if (IsLeaf(ref))
+        {
+            auto leaf { AsLeaf(ref) };
+
+            if (Traits_t::Encode(leaf->Key) != bytes)
+                return false;
+
+            delete leaf;
+            ref = 0;
+            this->ItemCount--;
+            return true;
+        }
+
+        auto node { AsNode(ref) };
+        auto start { depth };
+
+        // Check the stored prefix bytes; the rest are checked at the leaf.
+        if (node->PrefixLength > 0)
+        {
+            if (depth + node->PrefixLength > bytes.size())
+                return false;
+
+            auto stored { std::min(node->PrefixLength, MaxPrefix) };
+
+            for (std::uint32_t i = 0; i < stored; i++)
+            {
+                if (node->Prefix[i] != static_cast<std::uint8_t>(bytes[depth + i]))
+                    return false;
+            }
+
+            depth += node->PrefixLength;
+        }
+
+        if (depth == bytes.size())
+        {
+            auto leaf { node->Terminal };
+
+            if (leaf == nullptr || Traits_t::Encode(leaf->Key) != bytes)
+                return false;
+
+            delete leaf;
+            node->Terminal = nullptr;
+            this->ItemCount--;
+
+            Shrink(ref, start);
+            return true;
+        }
+
+        auto byte { static_cast<std::uint8_t>(bytes[depth]) };
+        auto child { FindChild(node, byte) };
+
+        if (child == nullptr || !this->Remove(*child, bytes, depth + 1))
+            return false;
+
+        if (*child == 0)
+        {
+            RemoveChild(node, byte);
+            Shrink(ref, start);
+        }
+
+        return true;
+    }
+
+    // Using declaration for a function that takes a leaf.
+    using leafCallback = std::function<bool (const Leaf& leaf)>;
+
+    // Visit the leaves below the given reference in key order, stopping if
+    // the function returns false. Returns false if it was stopped.
+    static bool Walk(Ref ref, const leafCallback& callback)
+    {
+        if (ref == 0)
+            return true;
+
+        if (IsLeaf(ref))
+            return callback(*AsLeaf(ref));
+
+        auto node { AsNode(ref) };
+
+        if (node->Terminal != nullptr && !callback(*node->Terminal))
+            return false;
+
+        return ForEachChild(node, [&callback](std::uint8_t, Ref child)
+        {
+            return Walk(child, callback);
+        });
+    }
+
+    // Visit the leaves below the given reference with keys in [low, high),
+    // skipping subtrees that lie wholly outside it. While lowBound is set
+    // the subtree may still hold keys below low. Returns false once the
+    // walk has passed high or was stopped.
+    static bool WalkRange(Ref ref, std::size_t depth, const std::string& low, const std::string& high,
+                          bool lowBound, const leafCallback& callback)
+    {
+        if (IsLeaf(ref))
+        {
+            auto leaf { AsLeaf(ref) };
+            auto bytes { Traits_t::Encode(leaf->Key) };
+
+            if (bytes >= high)
+                return false;
+
+            if (lowBound && bytes < low)
+                return true;
+
+            return callback(*leaf);
+        }
+
+        auto node { AsNode(ref) };
+
+        // Every key below here starts with this path.
+        depth += node->PrefixLength;
+        auto path { Traits_t::Encode(MinimumLeaf(ref)->Key).substr(0, depth) };
+
+        if (path >= high)
+            return false;
+
+        if (lowBound)
+        {
+            auto lowPath { low.substr(0, depth) };
+
+            if (path < lowPath)
+                return true;
+
+            if (path > lowPath)
+                lowBound = false;
+        }
+
+        if (node->Terminal != nullptr && !(lowBound && path < low) && !callback(*node->Terminal))
+            return false;
+
+        return ForEachChild(node, [&](std::uint8_t byte, Ref child)
+        {
+            // Children before the low key's next byte hold only smaller keys.
+            if (lowBound && depth < low.size() && byte < static_cast<std::uint8_t>(low[depth]))
+                return true;
+
+            return WalkRange(child, depth + 1, low, high, lowBound && depth < low.size() &&
+                             byte == static_cast<std::uint8_t>(low[depth]), callback);
+        });
+    }
+
+public:
+    // Default constructor.
+    ArtOrderedMap() = default;
+
+    // Copy constructor.
+    ArtOrderedMap(const ArtOrderedMap& other)
+    {
+        // Copy each item from the other map.
+        other.ForEach([this](const auto& lhs, const auto& rhs)
+        {
+            this->Set(lhs, rhs);
+            return true;
+        });
+    }
+
+    // Move constructor.
+    ArtOrderedMap(ArtOrderedMap&& other) noexcept :
+        Root(other.Root),
+        ItemCount(other.ItemCount)
+    {
+        other.Root = 0;
+        other.ItemCount = 0;
+    }
+
+    // Destructor.
+    ~ArtOrderedMap()
+    {
+        // Clear the map.
+        this->Clear();
+    }
+
+    // Clear all items from the map.
+    void Clear()
+    {
+        Destroy(this->Root);
+
+        this->Root = 0;
+        this->ItemCount = 0;
+    }
+
+    // Get the number of items in the map.
+    std::size_t Count() const
+    {
+        return this->ItemCount;
+    }
+
+    // Using declaration for a function that takes a key.
+    using keyCallback = std::function<void (const Key_t& key)>;
+
+    // Apply the given function to each key in the map, in sorted order.
+    void ForEachKey(keyCallback callback) const
+    {
+        Walk(this->Root, [&callback](const Leaf& leaf)
+        {
+            callback(leaf.Key);
+            return true;
+        });
+    }
+
+    // Using declaration for a function that takes a key and a value.
+    using kvCallback = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Apply the given function to each key-value pair in the map, in sorted order.
+    void ForEach(kvCallback callback) const
+    {
+        Walk(this->Root, [&callback](const Leaf& leaf)
+        {
+            return callback(leaf.Key, leaf.Value);
+        });
+    }
+
+    // Apply the given function, in sorted order, to each key-value pair
+    // whose encoded key starts with the given bytes. For string keys that
+    // is every key with the given prefix.
+    void ForEachPrefix(const std::string& prefix, kvCallback callback) const
+    {
+        auto ref { this->Root };
+        std::size_t depth { 0 };
+
+        // Walk down until the prefix is used up.
+        while (ref != 0 && !IsLeaf(ref) && depth < prefix.size())
+        {
+            auto node { AsNode(ref) };
+            depth += node->PrefixLength;
+
+            if (depth >= prefix.size())
+                break;
+
+            auto child { FindChild(node, static_cast<std::uint8_t>(prefix[depth])) };
+            if (child == nullptr)
+                return;
+
+            ref = *child;
+            depth++;
+        }
+
+        if (ref == 0)
+            return;
+
+        // Prefix bytes skipped on the way down are checked against each leaf.
+        Walk(ref, [&prefix, &callback](const Leaf& leaf)
+        {
+            auto bytes { Traits_t::Encode(leaf.Key) };
+
+            if (bytes.compare(0, prefix.size(), prefix) != 0)
+                return true;
+
+            return callback(leaf.Key, leaf.Value);
+        });
+    }
+
+    // Apply the given function, in sorted order, to each key-value pair
+    // with low <= key < high.
+    void ForEachRange(const Key_t& low, const Key_t& high, kvCallback callback) const
+    {
+        if (this->Root == 0)
+            return;
+
+        WalkRange(this->Root, 0, Traits_t::Encode(low), Traits_t::Encode(high), true, [&callback](const Leaf& leaf)
+        {
+            return callback(leaf.Key, leaf.Value);
+        });
+    }
+
+    // Set the value for the given key in the map. As with OrderedMap, an
+    // existing key keeps its value.
+    void Set(const Key_t& key, const Value_t& value)
+    {
+        this->Insert(this->Root, Traits_t::Encode(key), 0, key, value);
+    }
+
+    // Get the value for the given key in the map.
+    Value_t* Get(const Key_t& key) const
+    {
+        auto leaf { this->Search(Traits_t::Encode(key)) };
+        if (leaf == nullptr)
+            return nullptr;
+
+        return &leaf->Value;
+    }
+
+    // Check if the map contains the given key.
+    bool Exists(const Key_t& key) const
+    {
+        return this->Search(Traits_t::Encode(key)) != nullptr;
+    }
+
+    // Remove the given key from the map. Returns true if it was present.
+    bool Erase(const Key_t& key)
+    {
+        return this->Remove(this->Root, Traits_t::Encode(key), 0);
+    }
+
+    // Using declaration for a function that takes a key and a value and returns a bool.
+    using KeyValuePredicate = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Remove every pair for which the predicate returns true. Returns the
+    // number of pairs removed.
+    std::size_t EraseIf(const KeyValuePredicate& predicate)
+    {
+        std::vector<Key_t> doomed;
+
+        // Collect first; removing while walking would reshape the tree under us.
+        this->ForEach([&doomed, &predicate](const Key_t& key, const Value_t& value)
+        {
+            if (predicate(key, value))
+                doomed.push_back(key);
+
+            return true;
+        });
+
+        for (const auto& key : doomed)
+            this->Erase(key);
+
+        return doomed.size();
+    }
+
+    // Overloaded << operator for merging another map into this one.
+    ArtOrderedMap& operator<<(const ArtOrderedMap& other)
+    {
+        assert(&other != this);
+
+        // Merge each item from the other map into this one.
+        other.ForEach([this](const auto& lhs, const auto& rhs)
+        {
+            this->Set(lhs, rhs);
+            return true;
+        });
+
+        return *this;
+    }
+
+    // Overloaded = operator for copying another map into this one.
+    ArtOrderedMap& operator=(const ArtOrderedMap& other)
+    {
+        assert(&other != this);
+
+        // Clear this map and then copy each item from the other map.
+        this->Clear();
+        other.ForEach([this](const auto& lhs, const auto& rhs)
+        {
+            this->Set(lhs, rhs);
+            return true;
+        });
+
+        return *this;
+    }
+
+    // Overloaded = operator for moving another map into this one.
+    ArtOrderedMap& operator=(ArtOrderedMap&& other) noexcept
+    {
+        assert(&other != this);
+
+        // Clear this map and then move the items from the other map.
+        this->Clear();
+        this->Root = other.Root;
+        this->ItemCount = other.ItemCount;
+        other.Root = 0;
+        other.ItemCount = 0;
+
+        return *this;
+    }
+};
+
+#endif // Foundation42_ArtOrderedMap_H
@@ -0,0 +1,122 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_ArtOrderedSet_H
+#define Foundation42_ArtOrderedSet_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <string>
+
+#include "ArtOrderedMap.h"
+
+// Template class for an ordered set built on an adaptive radix tree. It is
+// an ArtOrderedMap whose values carry nothing.
+template <typename Key_t, typename Traits_t = ArtKeyTraits<Key_t>>
+class ArtOrderedSet
+{
+private:
+    // Structure for the empty value stored with each key.
+    struct Empty
+    {
+    };
+
+    ArtOrderedMap<Key_t, Empty, Traits_t> Items; // Underlying tree.
+
+public:
+    // Using declaration for a function that takes a key.
+    using keyCallback = std::function<void (const Key_t& key)>;
+
+    // Using declaration for a function that takes a key and may stop the walk.
+    using keyWalkCallback = std::function<bool (const Key_t& key)>;
+
+    // Clear all items from the set.
+    void Clear()
+    {
+        this->Items.Clear();
+    }
+
+    // Get the number of items in the set.
+    std::size_t Count() const
+    {
+        return this->Items.Count();
+    }
+
+    // Add the given key to the set if it is not already present.
+    void Add(const Key_t& key)
+    {
+        this->Items.Set(key, Empty {});
+    }
+
+    // Remove the given key from the set. Returns true if it was present.
+    bool Erase(const Key_t& key)
+    {
+        return this->Items.Erase(key);
+    }
+
+    // Using declaration for a function that takes a key and returns a bool.
+    using KeyPredicate = std::function<bool (const Key_t& key)>;
+
+    // Remove every key for which the predicate returns true. Returns the
+    // number of keys removed.
+    std::size_t EraseIf(const KeyPredicate& predicate)
+    {
+        return this->Items.EraseIf([&predicate](const Key_t& key, const Empty&)
+        {
+            return predicate(key);
+        });
+    }
+
+    // Check if the set contains the given key.
+    bool Exists(const Key_t& key) const
+    {
+        return this->Items.Exists(key);
+    }
+
+    // Apply the given function to each key in the set, in sorted order.
+    void ForEach(keyCallback callback) const
+    {
+        this->Items.ForEachKey(callback);
+    }
+
+    // Apply the given function, in sorted order, to each key whose encoded
+    // bytes start with the given prefix, until it returns false.
+    void ForEachPrefix(const std::string& prefix, keyWalkCallback callback) const
+    {
+        this->Items.ForEachPrefix(prefix, [&callback](const Key_t& key, const Empty&)
+        {
+            return callback(key);
+        });
+    }
+
+    // Apply the given function, in sorted order, to each key with
+    // low <= key < high, until it returns false.
+    void ForEachRange(const Key_t& low, const Key_t& high, keyWalkCallback callback) const
+    {
+        this->Items.ForEachRange(low, high, [&callback](const Key_t& key, const Empty&)
+        {
+            return callback(key);
+        });
+    }
+};
+
+#endif // Foundation42_ArtOrderedSet_H
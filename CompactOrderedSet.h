@@ -0,0 +1,659 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_CompactOrderedSet_H
+#define Foundation42_CompactOrderedSet_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "NodeReclaimer.h"
+#include "SortedSetAlgebra.h"
+
+// Template class for an ordered set whose nodes live in a single array.
+// Nodes are linked by 32-bit indices rather than pointers, so a set of
+// 4-byte keys costs 8 bytes per entry instead of a pointer plus a malloc
+// header, and neighbouring entries share cache lines.
+//
+// While the nodes sit in the array in set order, as after Compact() or
+// after building with InsertSorted in increasing order, Intersect and
+// Difference run over the array directly with SortedSetAlgebra, which
+// gallops through much larger sets and compares 32-bit keys with SIMD.
+template <typename Key_t, typename Allocator_t = std::allocator<Key_t>>
+class CompactOrderedSet
+{
+private:
+    using Index_t = std::uint32_t;
+
+    static constexpr Index_t NullIndex { UINT32_MAX }; // End of a chain.
+
+    // Structure for a node in the set.
+    struct Node
+    {
+        Key_t Key;
+        Index_t Next { NullIndex };
+    };
+
+    // Allocator type for the node array.
+    using NodeAllocator_t = typename std::allocator_traits<Allocator_t>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator_t>;
+
+    std::vector<Node, NodeAllocator_t> Nodes; // Storage for all nodes, live and free.
+    Index_t Head { NullIndex }; // Head of the set.
+    Index_t FreeHead { NullIndex }; // Head of the chain of freed nodes.
+    std::size_t ItemCount { 0 }; // Number of items in the set.
+    bool Sequential { true }; // Whether the items are the first nodes of the array, in order.
+    NodeReclaimer* Reclaimer { nullptr }; // Frees cleared nodes off this thread, if set.
+
+    // Note that the given node was just linked in after the given previous
+    // node, which keeps the set sequential only if both are at the end.
+    void Linked(Index_t node, Index_t previous, Index_t next)
+    {
+        auto expected { previous == NullIndex ? 0 : previous + 1 };
+        this->Sequential = this->Sequential && next == NullIndex && node == expected;
+    }
+
+    // Get a view of the keys of a sequential, non-empty set.
+    SortedSetAlgebra::StridedKeys<Key_t, sizeof(Node)> Keys() const
+    {
+        return { reinterpret_cast<const unsigned char*>(&this->Nodes[0].Key) };
+    }
+
+    // Allocate a node for the given key, reusing a freed node if possible.
+    Index_t AllocateNode(const Key_t& key)
+    {
+        if (this->FreeHead != NullIndex)
+        {
+            auto index { this->FreeHead };
+            this->FreeHead = this->Nodes[index].Next;
+            this->Nodes[index].Key = key;
+            this->Nodes[index].Next = NullIndex;
+            return index;
+        }
+
+        assert(this->Nodes.size() < NullIndex);
+
+        auto index { static_cast<Index_t>(this->Nodes.size()) };
+        this->Nodes.push_back({ key, NullIndex });
+        return index;
+    }
+
+    // Return the given node to the free chain.
+    void ReleaseNode(Index_t index)
+    {
+        this->Nodes[index].Next = this->FreeHead;
+        this->FreeHead = index;
+    }
+
+    // Kinds of merge that can be run over two sorted sets.
+    enum class MergeKind
+    {
+        Union,
+        Intersect,
+        Difference
+    };
+
+    // Walk this set and the other in step, passing each key that belongs in
+    // the result to the callback. Both sets must be in sorted order.
+    template <typename Callback_t>
+    void Merge(const CompactOrderedSet& other, MergeKind kind, Callback_t&& callback) const
+    {
+        auto left { this->Head };
+        auto right { other.Head };
+
+        while (left != NullIndex && right != NullIndex)
+        {
+            if (this->Nodes[left].Key < other.Nodes[right].Key)
+            {
+                if (kind != MergeKind::Intersect)
+                    callback(this->Nodes[left].Key);
+
+                left = this->Nodes[left].Next;
+            }
+            else if (other.Nodes[right].Key < this->Nodes[left].Key)
+            {
+                if (kind == MergeKind::Union)
+                    callback(other.Nodes[right].Key);
+
+                right = other.Nodes[right].Next;
+            }
+            else
+            {
+                if (kind != MergeKind::Difference)
+                    callback(this->Nodes[left].Key);
+
+                left = this->Nodes[left].Next;
+                right = other.Nodes[right].Next;
+            }
+        }
+
+        // Whatever is left of this set belongs to a union or difference.
+        for (; left != NullIndex && kind != MergeKind::Intersect; left = this->Nodes[left].Next)
+            callback(this->Nodes[left].Key);
+
+        // Whatever is left of the other set belongs to a union.
+        for (; right != NullIndex && kind == MergeKind::Union; right = other.Nodes[right].Next)
+            callback(other.Nodes[right].Key);
+    }
+
+    // Pass each key of the intersection or difference to the callback,
+    // working on the arrays directly when both sets are sequential.
+    template <typename Callback_t>
+    void Combine(const CompactOrderedSet& other, MergeKind kind, Callback_t&& callback) const
+    {
+        if (kind == MergeKind::Union || !this->Sequential || !other.Sequential ||
+            this->ItemCount == 0 || other.ItemCount == 0)
+        {
+            this->Merge(other, kind, callback);
+        }
+        else if (kind == MergeKind::Intersect)
+        {
+            SortedSetAlgebra::Intersect(this->Keys(), this->ItemCount, other.Keys(), other.ItemCount, callback);
+        }
+        else
+        {
+            SortedSetAlgebra::Difference(this->Keys(), this->ItemCount, other.Keys(), other.ItemCount, callback);
+        }
+    }
+
+    // Build a new set from a merge, appending each key at the tail.
+    CompactOrderedSet MergeToSet(const CompactOrderedSet& other, MergeKind kind) const
+    {
+        CompactOrderedSet result { this->GetAllocator() };
+        Index_t tail { NullIndex };
+
+        // Reserve for the largest possible result so the array never regrows.
+        if (kind == MergeKind::Union)
+            result.Reserve(this->ItemCount + other.ItemCount);
+        else if (kind == MergeKind::Intersect)
+            result.Reserve(std::min(this->ItemCount, other.ItemCount));
+        else
+            result.Reserve(this->ItemCount);
+
+        this->Combine(other, kind, [&result, &tail](const Key_t& key)
+        {
+            auto node { result.AllocateNode(key) };
+
+            if (tail == NullIndex)
+                result.Head = node;
+            else
+                result.Nodes[tail].Next = node;
+
+            tail = node;
+            result.ItemCount++;
+        });
+
+        return result;
+    }
+
+public:
+    // Default constructor.
+    CompactOrderedSet() = default;
+
+    // Construct an empty set that allocates its nodes from the given allocator.
+    explicit CompactOrderedSet(const Allocator_t& allocator) :
+        Nodes(NodeAllocator_t(allocator))
+    {
+    }
+
+    // Copy constructor.
+    CompactOrderedSet(const CompactOrderedSet& other) = default;
+
+    // Move constructor.
+    CompactOrderedSet(CompactOrderedSet&& other) noexcept :
+        Nodes(std::move(other.Nodes)),
+        Head(other.Head),
+        FreeHead(other.FreeHead),
+        ItemCount(other.ItemCount),
+        Sequential(other.Sequential),
+        Reclaimer(other.Reclaimer)
+    {
+        other.Nodes.clear();
+        other.Head = NullIndex;
+        other.FreeHead = NullIndex;
+        other.ItemCount = 0;
+        other.Sequential = true;
+    }
+
+    // Destructor.
+    ~CompactOrderedSet()
+    {
+        // Clear the set.
+        this->Clear();
+    }
+
+    // Use the given reclaimer to free nodes when the set is cleared or
+    // destroyed, or pass nullptr to free them synchronously again. Nodes
+    // from an allocator that is not ReclaimableAllocator, such as those of
+    // the pmr aliases, are always freed synchronously.
+    void SetReclaimer(NodeReclaimer* reclaimer)
+    {
+        this->Reclaimer = reclaimer;
+    }
+
+    // Clear all items from the set.
+    void Clear()
+    {
+        // Hand the whole node array to the reclaimer if there is one and it may
+        // free through our allocator.
+        if (ReclaimableAllocator<NodeAllocator_t>::value && this->Reclaimer != nullptr && !this->Nodes.empty())
+        {
+            this->Reclaimer->Enqueue([nodes = std::move(this->Nodes)](std::size_t budget) mutable
+            {
+                while (!nodes.empty() && budget > 0)
+                {
+                    nodes.pop_back();
+                    budget--;
+                }
+
+                if (!nodes.empty())
+                    return false;
+
+                nodes.shrink_to_fit();
+                return true;
+            });
+        }
+
+        this->Nodes.clear();
+        this->Head = NullIndex;
+        this->FreeHead = NullIndex;
+        this->ItemCount = 0;
+        this->Sequential = true;
+    }
+
+    // Reserve storage for the given number of items.
+    void Reserve(std::size_t capacity)
+    {
+        assert(capacity <= NullIndex);
+        this->Nodes.reserve(capacity);
+    }
+
+    // Get the number of items in the set.
+    std::size_t Count() const
+    {
+        return this->ItemCount;
+    }
+
+    // Using declaration for a function that takes a key.
+    using keyCallback = std::function<void (const Key_t& key)>;
+
+    // Apply the given function to each key in the set.
+    void ForEach(keyCallback callback) const
+    {
+        auto current { this->Head };
+
+        while (current != NullIndex)
+        {
+            callback(this->Nodes[current].Key);
+            current = this->Nodes[current].Next;
+        }
+    }
+
+    // Using declaration for a function that takes a mutable key.
+    using mutableKeyCallback = std::function<void (Key_t& key)>;
+
+    // Apply the given function to each key in the set.
+    void MutableForEach(mutableKeyCallback callback)
+    {
+        auto current { this->Head };
+
+        while (current != NullIndex)
+        {
+            callback(this->Nodes[current].Key);
+            current = this->Nodes[current].Next;
+        }
+    }
+
+    // Find the node with the given key, or create one if it does not exist.
+    int FindOrCreate(const Key_t& key)
+    {
+        auto itemIndex { 0 };
+
+        auto current { this->Head };
+        auto previous { NullIndex };
+
+        // Search through the nodes.
+        while (current != NullIndex)
+        {
+            // Return the index if we found it.
+            if (this->Nodes[current].Key == key)
+            {
+                return itemIndex;
+            }
+
+            previous = current;
+            current = this->Nodes[current].Next;
+            itemIndex++;
+        }
+
+        // We couldn't find it, so create it here.
+        auto newNode { this->AllocateNode(key) };
+
+        // If this is the first node, set it as the head.
+        // Otherwise, add it after the previous node.
+        if (previous == NullIndex)
+        {
+            this->Head = newNode;
+        }
+        else
+        {
+            this->Nodes[previous].Next = newNode;
+        }
+
+        this->Linked(newNode, previous, NullIndex);
+        this->ItemCount++;
+
+        return itemIndex;
+    }
+
+    // Find the index of the node with the given key.
+    int Find(const Key_t& key) const
+    {
+        auto itemIndex { 0 };
+
+        auto current { this->Head };
+
+        // Search through the nodes.
+        while (current != NullIndex)
+        {
+            // Return the index if we found it.
+            if (this->Nodes[current].Key == key)
+            {
+                return itemIndex;
+            }
+
+            current = this->Nodes[current].Next;
+            itemIndex++;
+        }
+
+        // We couldn't find it.
+        return -1;
+    }
+
+    // Get the key at the given index in the set.
+    const Key_t* GetAt(std::size_t index) const
+    {
+        auto current { this->Head };
+
+        for (auto i = 0u; i < index && current != NullIndex; ++i)
+            current = this->Nodes[current].Next;
+
+        if (current == NullIndex)
+            return nullptr;
+
+        return &this->Nodes[current].Key;
+    }
+
+    // Add the given key to the set.
+    std::size_t Add(const Key_t& key)
+    {
+        auto nodeIndex { this->FindOrCreate(key) };
+        return nodeIndex;
+    }
+
+    // Insert the given key into the set in sorted order.
+    void InsertSorted(const Key_t& key)
+    {
+        auto current { this->Head };
+        auto previous { NullIndex };
+
+        // Find the insert point.
+        while (current != NullIndex)
+        {
+            // Break if we found the insert point.
+            if (key < this->Nodes[current].Key)
+                break;
+
+            previous = current;
+            current = this->Nodes[current].Next;
+        }
+
+        auto node { this->AllocateNode(key) };
+
+        // If this is the first node, set it as the head.
+        // Otherwise, add it after the previous node.
+        if (previous == NullIndex)
+            this->Head = node;
+        else
+            this->Nodes[previous].Next = node;
+
+        this->Nodes[node].Next = current;
+        this->Linked(node, previous, current);
+        this->ItemCount++;
+    }
+
+    // Using declaration for a function that takes a key and returns a bool.
+    using KeyPredicate = std::function<bool (const Key_t& key)>;
+
+    // Remove the given key from the set. Returns true if it was present.
+    // The freed node is reused by the next insertion.
+    bool Erase(const Key_t& key)
+    {
+        auto current { this->Head };
+        auto previous { NullIndex };
+
+        while (current != NullIndex)
+        {
+            auto next { this->Nodes[current].Next };
+
+            if (this->Nodes[current].Key == key)
+            {
+                if (previous == NullIndex)
+                    this->Head = next;
+                else
+                    this->Nodes[previous].Next = next;
+
+                // Only losing the last item leaves the rest in place.
+                if (next != NullIndex)
+                    this->Sequential = false;
+
+                this->ReleaseNode(current);
+                this->ItemCount--;
+                return true;
+            }
+
+            previous = current;
+            current = next;
+        }
+
+        return false;
+    }
+
+    // Remove, in a single pass, every key for which the predicate returns
+    // true. Returns the number of keys removed.
+    std::size_t EraseIf(const KeyPredicate& predicate)
+    {
+        auto current { this->Head };
+        auto previous { NullIndex };
+        std::size_t erased { 0 };
+
+        while (current != NullIndex)
+        {
+            auto next { this->Nodes[current].Next };
+
+            if (predicate(this->Nodes[current].Key))
+            {
+                if (previous == NullIndex)
+                    this->Head = next;
+                else
+                    this->Nodes[previous].Next = next;
+
+                if (next != NullIndex)
+                    this->Sequential = false;
+
+                this->ReleaseNode(current);
+                this->ItemCount--;
+                erased++;
+            }
+            else
+            {
+                previous = current;
+            }
+
+            current = next;
+        }
+
+        return erased;
+    }
+
+    // Delete nodes for which the predicate returns true.
+    void DeleteNodes(const KeyPredicate predicate)
+    {
+        this->EraseIf(predicate);
+    }
+
+    // Rebuild the node array in set order, dropping freed nodes and
+    // returning their memory. Invalidates pointers returned by GetAt.
+    void Compact()
+    {
+        std::vector<Node, NodeAllocator_t> nodes(this->Nodes.get_allocator());
+        nodes.reserve(this->ItemCount);
+
+        auto current { this->Head };
+
+        while (current != NullIndex)
+        {
+            auto next { this->Nodes[current].Next };
+
+            nodes.push_back(std::move(this->Nodes[current]));
+            nodes.back().Next = static_cast<Index_t>(nodes.size());
+            current = next;
+        }
+
+        if (!nodes.empty())
+            nodes.back().Next = NullIndex;
+
+        this->Nodes.swap(nodes);
+        this->Head = this->Nodes.empty() ? NullIndex : 0;
+        this->FreeHead = NullIndex;
+        this->Sequential = true;
+    }
+
+    // Check if the set contains the given key.
+    bool Exists(const Key_t& key) const
+    {
+        auto nodeIndex { this->Find(key) };
+        return nodeIndex != -1;
+    }
+
+    // Get the union of this set and the other, in sorted order.
+    // Both sets must be in sorted order, as built by InsertSorted.
+    CompactOrderedSet Union(const CompactOrderedSet& other) const
+    {
+        return this->MergeToSet(other, MergeKind::Union);
+    }
+
+    // Apply the given function to each key in the union, in sorted order.
+    void Union(const CompactOrderedSet& other, keyCallback callback) const
+    {
+        this->Merge(other, MergeKind::Union, callback);
+    }
+
+    // Get the keys found in both this set and the other, in sorted order.
+    // Both sets must be in sorted order, as built by InsertSorted.
+    CompactOrderedSet Intersect(const CompactOrderedSet& other) const
+    {
+        return this->MergeToSet(other, MergeKind::Intersect);
+    }
+
+    // Apply the given function to each key in the intersection, in sorted order.
+    void Intersect(const CompactOrderedSet& other, keyCallback callback) const
+    {
+        this->Combine(other, MergeKind::Intersect, callback);
+    }
+
+    // Get the keys in this set that are not in the other, in sorted order.
+    // Both sets must be in sorted order, as built by InsertSorted.
+    CompactOrderedSet Difference(const CompactOrderedSet& other) const
+    {
+        return this->MergeToSet(other, MergeKind::Difference);
+    }
+
+    // Apply the given function to each key in the difference, in sorted order.
+    void Difference(const CompactOrderedSet& other, keyCallback callback) const
+    {
+        this->Combine(other, MergeKind::Difference, callback);
+    }
+
+    // Count the keys found in both this set and the other without building
+    // the intersection. Both sets must be in sorted order.
+    std::size_t IntersectCount(const CompactOrderedSet& other) const
+    {
+        std::size_t count { 0 };
+
+        if (this->Sequential && other.Sequential && this->ItemCount > 0 && other.ItemCount > 0)
+            return SortedSetAlgebra::IntersectCount(this->Keys(), this->ItemCount, other.Keys(), other.ItemCount);
+
+        this->Merge(other, MergeKind::Intersect, [&count](const Key_t&)
+        {
+            count++;
+        });
+
+        return count;
+    }
+
+    // Overloaded = operator for copying another set into this one.
+    CompactOrderedSet& operator=(const CompactOrderedSet& other) = default;
+
+    // Overloaded = operator for moving another set into this one. Between
+    // unequal allocators the node array is copied, which may throw.
+    CompactOrderedSet& operator=(CompactOrderedSet&& other)
+        noexcept(NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
+    {
+        assert(&other != this);
+
+        // Clear this one first so the old nodes go through the reclaimer.
+        this->Clear();
+        this->Nodes = std::move(other.Nodes);
+        this->Head = other.Head;
+        this->FreeHead = other.FreeHead;
+        this->ItemCount = other.ItemCount;
+        this->Sequential = other.Sequential;
+
+        other.Nodes.clear();
+        other.Head = NullIndex;
+        other.FreeHead = NullIndex;
+        other.ItemCount = 0;
+        other.Sequential = true;
+
+        return *this;
+    }
+
+    // Get the allocator used by the set.
+    Allocator_t GetAllocator() const
+    {
+        return Allocator_t(this->Nodes.get_allocator());
+    }
+};
+
+namespace pmr
+{
+    // CompactOrderedSet that allocates its nodes from a std::pmr::memory_resource.
+    template <typename Key_t>
+    using CompactOrderedSet = ::CompactOrderedSet<Key_t, std::pmr::polymorphic_allocator<Key_t>>;
+}
+
+#endif // Foundation42_CompactOrderedSet_H
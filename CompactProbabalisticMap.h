@@ -0,0 +1,438 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_CompactProbabalisticMap_H
+#define Foundation42_CompactProbabalisticMap_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "NodeReclaimer.h"
+
+// Template class for a probabilistic map whose nodes live in a single array.
+// Nodes are linked by 32-bit indices and the probability counter is narrowed
+// to 32 bits (saturating), so the link and counter share one 8-byte word.
+template <typename Key_t, typename Value_t,
+          typename Allocator_t = std::allocator<std::pair<const Key_t, Value_t>>>
+class CompactProbabalisticMap
+{
+private:
+    using Index_t = std::uint32_t;
+    using Probability_t = std::uint32_t;
+
+    static constexpr Index_t NullIndex { UINT32_MAX }; // End of a chain.
+    static constexpr Probability_t MaxProbability { UINT32_MAX }; // Counter ceiling.
+
+    // Structure for a node in the map.
+    struct Node
+    {
+        Key_t Key;
+        Value_t Value;
+        Probability_t Probability { 0 };
+        Index_t Next { NullIndex };
+    };
+
+    // Allocator type for the node array.
+    using NodeAllocator_t = typename std::allocator_traits<Allocator_t>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator_t>;
+
+    mutable std::vector<Node, NodeAllocator_t> Nodes; // Storage for all nodes, live and free.
+    mutable Index_t Head { NullIndex }; // Head of the map.
+    Index_t FreeHead { NullIndex }; // Head of the chain of freed nodes.
+    std::size_t ItemCount { 0 }; // Number of items in the map.
+    NodeReclaimer* Reclaimer { nullptr }; // Frees cleared nodes off this thread, if set.
+
+    // Insert a new node with the given key at the front of the map,
+    // reusing a freed node if possible.
+    Index_t PushNodeAtFront(const Key_t& key)
+    {
+        auto newNode { this->FreeHead };
+
+        if (newNode != NullIndex)
+        {
+            this->FreeHead = this->Nodes[newNode].Next;
+            this->Nodes[newNode] = { key, Value_t {}, 0, this->Head };
+        }
+        else
+        {
+            assert(this->Nodes.size() < NullIndex);
+
+            newNode = static_cast<Index_t>(this->Nodes.size());
+            this->Nodes.push_back({ key, Value_t {}, 0, this->Head });
+        }
+
+        this->Head = newNode;
+        this->ItemCount++;
+
+        return newNode;
+    }
+
+    // Return the given node to the free chain.
+    void ReleaseNode(Index_t index)
+    {
+        this->Nodes[index].Next = this->FreeHead;
+        this->FreeHead = index;
+    }
+
+    // Find the slot of the node with the given key in the map.
+    Index_t Find(const Key_t& key) const
+    {
+        auto current { this->Head };
+        auto previous { NullIndex };
+
+        // Search through the nodes.
+        while (current != NullIndex)
+        {
+            auto& node { this->Nodes[current] };
+
+            // Check if we found it.
+            if (node.Key == key)
+            {
+                // If node at the front we are done.
+                if (previous == NullIndex)
+                    return current;
+
+                // Update the probability.
+                if (node.Probability != MaxProbability)
+                    node.Probability++;
+
+                // Move it to the front if its probability is higher than the front node.
+                if (node.Probability < this->Nodes[this->Head].Probability)
+                    return current;
+
+                this->Nodes[previous].Next = node.Next;
+                node.Next = this->Head;
+                this->Head = current;
+
+                return current;
+            }
+
+            previous = current;
+            current = node.Next;
+        }
+
+        // We couldn't find it.
+        return NullIndex;
+    }
+
+    // Find the node with the given key, or create one if it does not exist.
+    Index_t FindOrCreate(const Key_t& key)
+    {
+        auto node { this->Find(key) };
+
+        if (node != NullIndex)
+            return node;
+
+        // If we couldn't find it, create one at the front.
+        return this->PushNodeAtFront(key);
+    }
+
+public:
+    // Default constructor.
+    CompactProbabalisticMap() = default;
+
+    // Construct an empty map that allocates its nodes from the given allocator.
+    explicit CompactProbabalisticMap(const Allocator_t& allocator) :
+        Nodes(NodeAllocator_t(allocator))
+    {
+    }
+
+    // Copy constructor.
+    CompactProbabalisticMap(const CompactProbabalisticMap& other) = default;
+
+    // Move constructor.
+    CompactProbabalisticMap(CompactProbabalisticMap&& other) noexcept :
+        Nodes(std::move(other.Nodes)),
+        Head(other.Head),
+        FreeHead(other.FreeHead),
+        ItemCount(other.ItemCount),
+        Reclaimer(other.Reclaimer)
+    {
+        other.Nodes.clear();
+        other.Head = NullIndex;
+        other.FreeHead = NullIndex;
+        other.ItemCount = 0;
+    }
+
+    // Destructor.
+    ~CompactProbabalisticMap()
+    {
+        // Clear the map.
+        this->Clear();
+    }
+
+    // Use the given reclaimer to free nodes when the map is cleared or
+    // destroyed, or pass nullptr to free them synchronously again. Nodes
+    // from an allocator that is not ReclaimableAllocator, such as those of
+    // the pmr aliases, are always freed synchronously.
+    void SetReclaimer(NodeReclaimer* reclaimer)
+    {
+        this->Reclaimer = reclaimer;
+    }
+
+    // Clear all items from the map.
+    void Clear()
+    {
+        // Hand the whole node array to the reclaimer if there is one and it may
+        // free through our allocator.
+        if (ReclaimableAllocator<NodeAllocator_t>::value && this->Reclaimer != nullptr && !this->Nodes.empty())
+        {
+            this->Reclaimer->Enqueue([nodes = std::move(this->Nodes)](std::size_t budget) mutable
+            {
+                while (!nodes.empty() && budget > 0)
+                {
+                    nodes.pop_back();
+                    budget--;
+                }
+
+                if (!nodes.empty())
+                    return false;
+
+                nodes.shrink_to_fit();
+                return true;
+            });
+        }
+
+        this->Nodes.clear();
+        this->Head = NullIndex;
+        this->FreeHead = NullIndex;
+        this->ItemCount = 0;
+    }
+
+    // Reserve storage for the given number of items.
+    void Reserve(std::size_t capacity)
+    {
+        assert(capacity <= NullIndex);
+        this->Nodes.reserve(capacity);
+    }
+
+    // Using declaration for a function that takes a key.
+    using keyCallback = std::function<void (const Key_t& key)>;
+
+    // Apply the given function to each key in the map.
+    void ForEachKey(keyCallback callback) const
+    {
+        auto current { this->Head };
+
+        while (current != NullIndex)
+        {
+            callback(this->Nodes[current].Key);
+            current = this->Nodes[current].Next;
+        }
+    }
+
+    // Using declaration for a function that takes a key and a value.
+    using kvCallback = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Apply the given function to each key-value pair in the map.
+    void ForEach(kvCallback callback) const
+    {
+        auto current { this->Head };
+
+        while (current != NullIndex)
+        {
+            const auto& node { this->Nodes[current] };
+
+            if (!callback(node.Key, node.Value))
+                break;
+
+            current = node.Next;
+        }
+    }
+
+    // Get the number of items in the map.
+    std::size_t Count() const
+    {
+        return this->ItemCount;
+    }
+
+    // Set the value for the given key in the map.
+    void Set(const Key_t& key, const Value_t& value)
+    {
+        auto node { this->FindOrCreate(key) };
+        this->Nodes[node].Value = value;
+    }
+
+    // Get the value for the given key in the map.
+    // The pointer is invalidated by the next insertion.
+    Value_t* Get(const Key_t& key) const
+    {
+        auto node { this->Find(key) };
+        if (node == NullIndex)
+            return nullptr;
+
+        return &this->Nodes[node].Value;
+    }
+
+    // Remove the given key from the map. Returns true if it was present.
+    // The freed node is reused by the next insertion.
+    bool Erase(const Key_t& key)
+    {
+        auto current { this->Head };
+        auto previous { NullIndex };
+
+        while (current != NullIndex)
+        {
+            auto next { this->Nodes[current].Next };
+
+            if (this->Nodes[current].Key == key)
+            {
+                if (previous == NullIndex)
+                    this->Head = next;
+                else
+                    this->Nodes[previous].Next = next;
+
+                this->ReleaseNode(current);
+                this->ItemCount--;
+                return true;
+            }
+
+            previous = current;
+            current = next;
+        }
+
+        return false;
+    }
+
+    // Using declaration for a function that takes a key and a value and returns a bool.
+    using KeyValuePredicate = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Remove, in a single pass, every pair for which the predicate returns
+    // true. Returns the number of pairs removed.
+    std::size_t EraseIf(const KeyValuePredicate& predicate)
+    {
+        auto current { this->Head };
+        auto previous { NullIndex };
+        std::size_t erased { 0 };
+
+        while (current != NullIndex)
+        {
+            auto& node { this->Nodes[current] };
+            auto next { node.Next };
+
+            if (predicate(node.Key, node.Value))
+            {
+                if (previous == NullIndex)
+                    this->Head = next;
+                else
+                    this->Nodes[previous].Next = next;
+
+                this->ReleaseNode(current);
+                this->ItemCount--;
+                erased++;
+            }
+            else
+            {
+                previous = current;
+            }
+
+            current = next;
+        }
+
+        return erased;
+    }
+
+    // Rebuild the node array in map order, dropping freed nodes and
+    // returning their memory. Invalidates pointers returned by Get.
+    void Compact()
+    {
+        std::vector<Node, NodeAllocator_t> nodes(this->Nodes.get_allocator());
+        nodes.reserve(this->ItemCount);
+
+        auto current { this->Head };
+
+        while (current != NullIndex)
+        {
+            auto next { this->Nodes[current].Next };
+
+            nodes.push_back(std::move(this->Nodes[current]));
+            nodes.back().Next = static_cast<Index_t>(nodes.size());
+            current = next;
+        }
+
+        if (!nodes.empty())
+            nodes.back().Next = NullIndex;
+
+        this->Nodes.swap(nodes);
+        this->Head = this->Nodes.empty() ? NullIndex : 0;
+        this->FreeHead = NullIndex;
+    }
+
+    // Overloaded << operator for merging another map into this one.
+    CompactProbabalisticMap& operator<<(const CompactProbabalisticMap& other)
+    {
+        assert(&other != this);
+
+        // Merge each item from the other map into this one.
+        other.ForEach([this](const auto& lhs, const auto& rhs)
+        {
+            this->Set(lhs, rhs);
+            return true;
+        });
+
+        return *this;
+    }
+
+    // Overloaded = operator for copying another map into this one.
+    CompactProbabalisticMap& operator=(const CompactProbabalisticMap& other) = default;
+
+    // Overloaded = operator for moving another map into this one. Between
+    // unequal allocators the node array is copied, which may throw.
+    CompactProbabalisticMap& operator=(CompactProbabalisticMap&& other)
+        noexcept(NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
+    {
+        assert(&other != this);
+
+        // Clear this one first so the old nodes go through the reclaimer.
+        this->Clear();
+        this->Nodes = std::move(other.Nodes);
+        this->Head = other.Head;
+        this->FreeHead = other.FreeHead;
+        this->ItemCount = other.ItemCount;
+
+        other.Nodes.clear();
+        other.Head = NullIndex;
+        other.FreeHead = NullIndex;
+        other.ItemCount = 0;
+
+        return *this;
+    }
+
+    // Get the allocator used by the map.
+    Allocator_t GetAllocator() const
+    {
+        return Allocator_t(this->Nodes.get_allocator());
+    }
+};
+
+namespace pmr
+{
+    // CompactProbabalisticMap that allocates its nodes from a std::pmr::memory_resource.
+    template <typename Key_t, typename Value_t>
+    using CompactProbabalisticMap = ::CompactProbabalisticMap<Key_t, Value_t, std::pmr::polymorphic_allocator<std::pair<const Key_t, Value_t>>>;
+}
+
+#endif // Foundation42_CompactProbabalisticMap_H
@@ -0,0 +1,186 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_ContainerBenchmarks_H
+#define Foundation42_ContainerBenchmarks_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MicroBenchmark.h"
+
+#if defined(__linux__)
+#include "HugePageArena.h"
+#endif
+
+// Class of standard benchmark runs for the containers, so that results for
+// different containers, builds and machines line up by name. Each run is
+// named "<name>::<operation>" and measures one call per key.
+class ContainerBenchmarks
+{
+public:
+    // Measure Set into an empty map, then Get and ForEach over the full
+    // map. Works with any of the maps that have Clear, Set, Get and ForEach.
+    // For ProbabalisticMap the Get run measures Find and its reordering.
+    // The given reset runs after each Clear, before Set, for example to
+    // recreate the map over a released memory resource.
+    template <typename Map_t, typename Key_t, typename Value_t>
+    static void RunMap(MicroBenchmark& bench, const std::string& name, Map_t& map,
+                       const std::vector<std::pair<Key_t, Value_t>>& pairs,
+                       const MicroBenchmark::Body& reset = []() {})
+    {
+        auto count { pairs.size() };
+        assert(count > 0);
+
+        bench.Run(name + "::Set", count,
+                  [&map, &reset]()
+                  {
+                      map.Clear();
+                      reset();
+                  },
+                  [&map, &pairs]()
+                  {
+                      for (const auto& pair : pairs)
+                          map.Set(pair.first, pair.second);
+                  });
+
+        bench.Run(name + "::Get", count, [&map, &pairs]()
+        {
+            for (const auto& pair : pairs)
+                MicroBenchmark::Keep(map.Get(pair.first));
+        });
+
+        bench.Run(name + "::ForEach", count, [&map]()
+        {
+            std::size_t visited { 0 };
+
+            map.ForEach([&visited](const auto&, const auto& value)
+            {
+                MicroBenchmark::Keep(value);
+                visited++;
+                return true;
+            });
+
+            MicroBenchmark::Keep(visited);
+        });
+    }
+
+    // Run RunMap twice, first over a map type with the default allocator
+    // and then over its pmr alias with a std::pmr::monotonic_buffer_resource
+    // that is released before each Set run, so every run allocates from a
+    // fresh buffer. The map is recreated rather than just cleared, since
+    // the compact maps keep their storage across Clear. Compare the
+    // "<name>/default" and "<name>/monotonic" runs to see what bump
+    // allocation saves over the heap, net of the pmr indirection.
+    //
+    //     ContainerBenchmarks::RunMonotonicComparison<OrderedMap<int, int>, pmr::OrderedMap<int, int>>(bench, "OrderedMap", pairs);
+    template <typename Map_t, typename PmrMap_t, typename Key_t, typename Value_t>
+    static void RunMonotonicComparison(MicroBenchmark& bench, const std::string& name,
+                                       const std::vector<std::pair<Key_t, Value_t>>& pairs)
+    {
+        {
+            Map_t map;
+            RunMap(bench, name + "/default", map, pairs);
+        }
+
+        std::pmr::monotonic_buffer_resource buffer;
+        std::optional<PmrMap_t> map { std::in_place, &buffer };
+
+        RunMap(bench, name + "/monotonic", *map, pairs, [&map, &buffer]()
+        {
+            map.reset();
+            buffer.release();
+            map.emplace(&buffer);
+        });
+    }
+
+#if defined(__linux__)
+    // Run RunMap twice over a pmr map type, first with its nodes on the
+    // default heap and then in a HugePageArena bound to the given NUMA
+    // node, or to none if negative. Compare the dtlb_misses of the
+    // "<name>/heap" and "<name>/hugepage" runs to see the TLB saving; it
+    // shows once the map outgrows the reach of the 4 KB-page TLB, at a few
+    // hundred thousand entries. Only available on Linux, like the arena.
+    //
+    //     ContainerBenchmarks::RunHugePageComparison<pmr::OrderedMap<int, int>>(bench, "OrderedMap", pairs);
+    template <typename PmrMap_t, typename Key_t, typename Value_t>
+    static void RunHugePageComparison(MicroBenchmark& bench, const std::string& name,
+                                      const std::vector<std::pair<Key_t, Value_t>>& pairs, int numaNode = -1)
+    {
+        {
+            PmrMap_t map { std::pmr::new_delete_resource() };
+            RunMap(bench, name + "/heap", map, pairs);
+        }
+
+        HugePageArena arena { numaNode };
+
+        {
+            PmrMap_t map { &arena };
+            RunMap(bench, name + "/hugepage", map, pairs);
+        }
+    }
+#endif
+
+    // Measure InsertSorted into an empty set, then Find and ForEach over
+    // the full set. Works with OrderedSet and CompactOrderedSet.
+    template <typename Set_t, typename Key_t>
+    static void RunSortedSet(MicroBenchmark& bench, const std::string& name, Set_t& set,
+                             const std::vector<Key_t>& keys)
+    {
+        auto count { keys.size() };
+        assert(count > 0);
+
+        bench.Run(name + "::InsertSorted", count,
+                  [&set]() { set.Clear(); },
+                  [&set, &keys]()
+                  {
+                      for (const auto& key : keys)
+                          set.InsertSorted(key);
+                  });
+
+        bench.Run(name + "::Find", count, [&set, &keys]()
+        {
+            for (const auto& key : keys)
+                MicroBenchmark::Keep(set.Find(key));
+        });
+
+        bench.Run(name + "::ForEach", count, [&set]()
+        {
+            std::size_t visited { 0 };
+
+            set.ForEach([&visited](const auto& key)
+            {
+                MicroBenchmark::Keep(key);
+                visited++;
+            });
+
+            MicroBenchmark::Keep(visited);
+        });
+    }
+};
+
+#endif // Foundation42_ContainerBenchmarks_H
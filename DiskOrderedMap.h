@@ -0,0 +1,710 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_DiskOrderedMap_H
+#define Foundation42_DiskOrderedMap_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Template class for an ordered map stored in memory-mapped files, for key
+// spaces larger than RAM. Entries are appended to a data file in insertion
+// order, and an open-addressed hash index in a second file maps each key to
+// its entry. Both files are paged in and out by the kernel: the data file is
+// advised for sequential access while ForEach runs, and the index for random
+// access, so lookups don't trigger useless readahead. Erased entries stay in
+// the data file, marked as erased, until Compact() rewrites it; a Fenwick
+// tree over the erased marks, built in memory the first time it is needed,
+// turns a record's position into its index among live items in O(log n).
+//
+// Keys and values are stored as raw bytes, so both must be trivially
+// copyable, and keys must have no padding so that equal keys hash equally.
+template <typename Key_t, typename Value_t>
+class DiskOrderedMap
+{
+private:
+    static_assert(std::is_trivially_copyable<Key_t>::value, "Keys are stored as raw bytes");
+    static_assert(std::is_trivially_copyable<Value_t>::value, "Values are stored as raw bytes");
+    static_assert(std::has_unique_object_representations<Key_t>::value, "Keys are hashed as raw bytes");
+
+    static constexpr std::uint64_t DataMagic { 0x46343244'4f4d4150ull }; // Identifies a data file.
+    static constexpr std::uint64_t IndexMagic { 0x46343244'4f4d4958ull }; // Identifies an index file.
+    static constexpr std::uint64_t FormatVersion { 2 }; // Bumped when the layout changes.
+    static constexpr std::uint64_t InitialCapacity { 1024 }; // Entries in a new data file.
+    static constexpr std::uint64_t EmptySlot { 0 }; // Index slot with no entry.
+
+    // Structure for the header at the start of the data file.
+    struct DataHeader
+    {
+        std::uint64_t Magic;
+        std::uint64_t Version;
+        std::uint64_t KeySize;
+        std::uint64_t ValueSize;
+        std::uint64_t RecordCount;
+        std::uint64_t RecordCapacity;
+        std::uint64_t LiveCount;
+    };
+
+    // Structure for the header at the start of the index file.
+    struct IndexHeader
+    {
+        std::uint64_t Magic;
+        std::uint64_t SlotCount;
+        std::uint64_t RecordCount;
+    };
+
+    // Structure for an entry in the data file.
+    struct Record
+    {
+        Key_t Key;
+        Value_t Value;
+        std::uint8_t Erased; // Non-zero once the entry has been erased.
+    };
+
+    std::string Path; // Path of the data file; the index adds ".index".
+    int DataFile { -1 }; // Descriptor of the data file.
+    int IndexFile { -1 }; // Descriptor of the index file.
+    void* DataMap { nullptr }; // Mapping of the data file.
+    std::size_t DataMapSize { 0 }; // Size of the data mapping.
+    void* IndexMap { nullptr }; // Mapping of the index file.
+    std::size_t IndexMapSize { 0 }; // Size of the index mapping.
+    mutable std::vector<std::uint64_t> Tombstones; // Fenwick tree of erased records, from 1.
+    mutable bool TombstonesBuilt { false }; // Whether Tombstones matches the data file.
+
+    // Throw an error for the failed system call.
+    [[noreturn]] static void ThrowError(const std::string& what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Get the size of a data file with room for the given number of records.
+    static std::size_t DataSizeFor(std::uint64_t capacity)
+    {
+        return sizeof(DataHeader) + capacity * sizeof(Record);
+    }
+
+    // Get the size of an index file with the given number of slots.
+    static std::size_t IndexSizeFor(std::uint64_t slotCount)
+    {
+        return sizeof(IndexHeader) + slotCount * sizeof(std::uint64_t);
+    }
+
+    // Hash the bytes of a key (64-bit FNV-1a), so the index stays valid
+    // across builds and standard libraries.
+    static std::uint64_t Hash(const Key_t& key)
+    {
+        auto bytes { reinterpret_cast<const unsigned char*>(&key) };
+        std::uint64_t hash { 0xcbf29ce484222325ull };
+
+        for (std::size_t i = 0; i < sizeof(Key_t); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+
+        return hash;
+    }
+
+    // Resize the given file and map it, replacing any previous mapping of it.
+    static void MapFile(int file, void*& mapping, std::size_t& mappingSize, std::size_t size, int advice)
+    {
+        if (mapping != nullptr)
+            munmap(mapping, mappingSize);
+
+        mapping = nullptr;
+        mappingSize = 0;
+
+        if (ftruncate(file, static_cast<off_t>(size)) != 0)
+            ThrowError("ftruncate");
+
+        auto result { mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) };
+        if (result == MAP_FAILED)
+            ThrowError("mmap");
+
+        madvise(result, size, advice);
+
+        mapping = result;
+        mappingSize = size;
+    }
+
+    // Get the header of the data file.
+    DataHeader* Data() const
+    {
+        return static_cast<DataHeader*>(this->DataMap);
+    }
+
+    // Get the first record in the data file.
+    Record* Records() const
+    {
+        return reinterpret_cast<Record*>(static_cast<char*>(this->DataMap) + sizeof(DataHeader));
+    }
+
+    // Get the header of the index file.
+    IndexHeader* Index() const
+    {
+        return static_cast<IndexHeader*>(this->IndexMap);
+    }
+
+    // Get the first slot in the index file.
+    std::uint64_t* Slots() const
+    {
+        return reinterpret_cast<std::uint64_t*>(static_cast<char*>(this->IndexMap) + sizeof(IndexHeader));
+    }
+
+    // Find the index slot holding the given key, or the empty slot where it would go.
+    std::uint64_t FindSlot(const Key_t& key) const
+    {
+        auto mask { this->Index()->SlotCount - 1 };
+        auto slot { Hash(key) & mask };
+        auto slots { this->Slots() };
+        auto records { this->Records() };
+
+        while (slots[slot] != EmptySlot)
+        {
+            if (std::memcmp(&records[slots[slot] - 1].Key, &key, sizeof(Key_t)) == 0)
+                return slot;
+
+            slot = (slot + 1) & mask;
+        }
+
+        return slot;
+    }
+
+    // Build a fresh index with the given number of slots from the data file.
+    void RebuildIndex(std::uint64_t slotCount)
+    {
+        MapFile(this->IndexFile, this->IndexMap, this->IndexMapSize, IndexSizeFor(slotCount), MADV_RANDOM);
+
+        std::memset(this->Slots(), 0, slotCount * sizeof(std::uint64_t));
+        this->Index()->Magic = IndexMagic;
+        this->Index()->SlotCount = slotCount;
+        this->Index()->RecordCount = 0;
+
+        auto count { this->Data()->RecordCount };
+
+        for (std::uint64_t i = 0; i < count; i++)
+        {
+            if (this->Records()[i].Erased)
+                continue;
+
+            auto slot { this->FindSlot(this->Records()[i].Key) };
+            this->Slots()[slot] = i + 1;
+        }
+
+        this->Index()->RecordCount = this->Data()->LiveCount;
+    }
+
+    // Get the number of index slots to use for the given number of entries.
+    static std::uint64_t SlotCountFor(std::uint64_t count)
+    {
+        auto slotCount { InitialCapacity * 2 };
+        while (slotCount < count * 2)
+            slotCount *= 2;
+
+        return slotCount;
+    }
+
+    // Empty the given index slot, shifting back any later entries in its
+    // probe run so that lookups never need tombstones.
+    void RemoveSlot(std::uint64_t hole)
+    {
+        auto mask { this->Index()->SlotCount - 1 };
+        auto slots { this->Slots() };
+        auto records { this->Records() };
+        auto next { (hole + 1) & mask };
+
+        while (slots[next] != EmptySlot)
+        {
+            auto home { Hash(records[slots[next] - 1].Key) & mask };
+
+            // Move the entry back if the hole lies between its home slot and where it is.
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+
+            next = (next + 1) & mask;
+        }
+
+        slots[hole] = EmptySlot;
+        this->Index()->RecordCount--;
+    }
+
+    // Build the Fenwick tree of erased records in one pass over the data file.
+    void BuildTombstones() const
+    {
+        auto count { this->Data()->RecordCount };
+        auto records { this->Records() };
+
+        this->Tombstones.assign(count + 1, 0);
+
+        for (std::uint64_t i = 0; i < count; i++)
+            this->Tombstones[i + 1] = records[i].Erased ? 1 : 0;
+
+        // Push each node's total up to its parent.
+        for (std::uint64_t i = 1; i <= count; i++)
+        {
+            auto parent { i + (i & (~i + 1)) };
+
+            if (parent <= count)
+                this->Tombstones[parent] += this->Tombstones[i];
+        }
+
+        this->TombstonesBuilt = true;
+    }
+
+    // Get the number of erased records before the given index.
+    std::uint64_t ErasedBefore(std::uint64_t index) const
+    {
+        std::uint64_t erased { 0 };
+
+        for (auto i = index; i > 0; i &= i - 1)
+            erased += this->Tombstones[i];
+
+        return erased;
+    }
+
+    // Note that the record at the given index was erased.
+    void MarkTombstone(std::uint64_t index)
+    {
+        if (!this->TombstonesBuilt)
+            return;
+
+        for (auto i = index + 1; i < this->Tombstones.size(); i += i & (~i + 1))
+            this->Tombstones[i]++;
+    }
+
+    // Note that a live record was appended.
+    void AppendTombstone()
+    {
+        if (!this->TombstonesBuilt)
+            return;
+
+        // The new node covers the records after its parent's range.
+        auto node { static_cast<std::uint64_t>(this->Tombstones.size()) };
+        this->Tombstones.push_back(this->ErasedBefore(node - 1) - this->ErasedBefore(node - (node & (~node + 1))));
+    }
+
+    // Forget the Fenwick tree, to be rebuilt when next needed.
+    void ResetTombstones()
+    {
+        this->Tombstones.clear();
+        this->TombstonesBuilt = false;
+    }
+
+    // Get the position among the live entries of the record at the given
+    // index. Costs O(log n), plus one pass to build the tree the first time
+    // anything erased needs counting.
+    std::size_t LiveOrdinal(std::uint64_t index) const
+    {
+        if (this->Data()->LiveCount == this->Data()->RecordCount)
+            return index;
+
+        if (!this->TombstonesBuilt)
+            this->BuildTombstones();
+
+        return index - this->ErasedBefore(index);
+    }
+
+    // Open or create both files.
+    void Open()
+    {
+        this->DataFile = open(this->Path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->DataFile < 0)
+            ThrowError("open " + this->Path);
+
+        auto indexPath { this->Path + ".index" };
+        this->IndexFile = open(indexPath.c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->IndexFile < 0)
+            ThrowError("open " + indexPath);
+
+        struct stat status;
+        if (fstat(this->DataFile, &status) != 0)
+            ThrowError("fstat");
+
+        // A new file gets a header and room for the first records.
+        if (status.st_size == 0)
+        {
+            MapFile(this->DataFile, this->DataMap, this->DataMapSize, DataSizeFor(InitialCapacity), MADV_NORMAL);
+            *this->Data() = { DataMagic, FormatVersion, sizeof(Key_t), sizeof(Value_t), 0, InitialCapacity, 0 };
+            this->RebuildIndex(InitialCapacity * 2);
+            return;
+        }
+
+        // An existing file must match our layout.
+        if (static_cast<std::size_t>(status.st_size) < sizeof(DataHeader))
+            throw std::runtime_error(this->Path + " is not a DiskOrderedMap data file");
+
+        DataHeader header;
+        if (pread(this->DataFile, &header, sizeof(header), 0) != sizeof(header))
+            ThrowError("pread");
+
+        if (header.Magic != DataMagic || header.Version != FormatVersion ||
+            header.KeySize != sizeof(Key_t) || header.ValueSize != sizeof(Value_t) ||
+            header.RecordCount > header.RecordCapacity || header.LiveCount > header.RecordCount ||
+            static_cast<std::size_t>(status.st_size) < DataSizeFor(header.RecordCapacity))
+            throw std::runtime_error(this->Path + " does not match this DiskOrderedMap");
+
+        MapFile(this->DataFile, this->DataMap, this->DataMapSize, DataSizeFor(header.RecordCapacity), MADV_NORMAL);
+
+        // Reuse the index if it is complete, otherwise rebuild it.
+        IndexHeader index {};
+        if (fstat(this->IndexFile, &status) != 0)
+            ThrowError("fstat");
+
+        if (static_cast<std::size_t>(status.st_size) >= sizeof(index) &&
+            pread(this->IndexFile, &index, sizeof(index), 0) == sizeof(index) &&
+            index.Magic == IndexMagic && index.RecordCount == header.LiveCount &&
+            index.SlotCount > header.RecordCount && (index.SlotCount & (index.SlotCount - 1)) == 0 &&
+            static_cast<std::size_t>(status.st_size) == IndexSizeFor(index.SlotCount))
+        {
+            MapFile(this->IndexFile, this->IndexMap, this->IndexMapSize, IndexSizeFor(index.SlotCount), MADV_RANDOM);
+            return;
+        }
+
+        this->RebuildIndex(SlotCountFor(header.LiveCount));
+    }
+
+    // Unmap and close both files.
+    void Close()
+    {
+        if (this->DataMap != nullptr)
+            munmap(this->DataMap, this->DataMapSize);
+
+        if (this->IndexMap != nullptr)
+            munmap(this->IndexMap, this->IndexMapSize);
+
+        if (this->DataFile >= 0)
+            close(this->DataFile);
+
+        if (this->IndexFile >= 0)
+            close(this->IndexFile);
+
+        this->DataMap = nullptr;
+        this->IndexMap = nullptr;
+        this->DataFile = -1;
+        this->IndexFile = -1;
+    }
+
+    // Append a record for the given pair and return its index.
+    std::uint64_t AppendRecord(const Key_t& key, const Value_t& value)
+    {
+        auto header { this->Data() };
+
+        // Double the data file when it is full.
+        if (header->RecordCount == header->RecordCapacity)
+        {
+            auto capacity { header->RecordCapacity * 2 };
+            MapFile(this->DataFile, this->DataMap, this->DataMapSize, DataSizeFor(capacity), MADV_NORMAL);
+
+            header = this->Data();
+            header->RecordCapacity = capacity;
+        }
+
+        auto index { header->RecordCount };
+        this->Records()[index] = { key, value, 0 };
+        header->RecordCount++;
+        header->LiveCount++;
+        this->AppendTombstone();
+
+        return index;
+    }
+
+public:
+    // Open the map stored at the given path, creating it if it does not exist.
+    explicit DiskOrderedMap(const std::string& path) :
+        Path(path)
+    {
+        try
+        {
+            this->Open();
+        }
+        catch (...)
+        {
+            this->Close();
+            throw;
+        }
+    }
+
+    DiskOrderedMap(const DiskOrderedMap&) = delete;
+    DiskOrderedMap& operator=(const DiskOrderedMap&) = delete;
+
+    // Move constructor.
+    DiskOrderedMap(DiskOrderedMap&& other) noexcept :
+        Path(std::move(other.Path)),
+        DataFile(other.DataFile),
+        IndexFile(other.IndexFile),
+        DataMap(other.DataMap),
+        DataMapSize(other.DataMapSize),
+        IndexMap(other.IndexMap),
+        IndexMapSize(other.IndexMapSize),
+        Tombstones(std::move(other.Tombstones)),
+        TombstonesBuilt(other.TombstonesBuilt)
+    {
+        other.DataFile = -1;
+        other.IndexFile = -1;
+        other.DataMap = nullptr;
+        other.IndexMap = nullptr;
+    }
+
+    // Overloaded = operator for moving another map into this one.
+    DiskOrderedMap& operator=(DiskOrderedMap&& other) noexcept
+    {
+        assert(&other != this);
+
+        // Close our files and then take over the other map's.
+        this->Close();
+        this->Path = std::move(other.Path);
+        this->DataFile = other.DataFile;
+        this->IndexFile = other.IndexFile;
+        this->DataMap = other.DataMap;
+        this->DataMapSize = other.DataMapSize;
+        this->IndexMap = other.IndexMap;
+        this->IndexMapSize = other.IndexMapSize;
+        this->Tombstones = std::move(other.Tombstones);
+        this->TombstonesBuilt = other.TombstonesBuilt;
+
+        other.DataFile = -1;
+        other.IndexFile = -1;
+        other.DataMap = nullptr;
+        other.IndexMap = nullptr;
+
+        return *this;
+    }
+
+    // Destructor.
+    ~DiskOrderedMap()
+    {
+        this->Close();
+    }
+
+    // Get the number of items in the map.
+    std::size_t Count() const
+    {
+        return this->Data()->LiveCount;
+    }
+
+    // Clear all items from the map, shrinking both files back down.
+    void Clear()
+    {
+        MapFile(this->DataFile, this->DataMap, this->DataMapSize, DataSizeFor(InitialCapacity), MADV_NORMAL);
+        this->Data()->RecordCount = 0;
+        this->Data()->RecordCapacity = InitialCapacity;
+        this->Data()->LiveCount = 0;
+        this->ResetTombstones();
+
+        this->RebuildIndex(InitialCapacity * 2);
+    }
+
+    // Write any changes back to disk.
+    void Flush()
+    {
+        if (msync(this->DataMap, this->DataMapSize, MS_SYNC) != 0)
+            ThrowError("msync");
+
+        if (msync(this->IndexMap, this->IndexMapSize, MS_SYNC) != 0)
+            ThrowError("msync");
+    }
+
+    // Using declaration for a function that takes a key.
+    using keyCallback = std::function<void (const Key_t& key)>;
+
+    // Apply the given function to each key in the map.
+    void ForEachKey(keyCallback callback) const
+    {
+        this->ForEach([&callback](const Key_t& key, const Value_t&)
+        {
+            callback(key);
+            return true;
+        });
+    }
+
+    // Using declaration for a function that takes a key and a value.
+    using kvCallback = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Apply the given function to each key-value pair in the map.
+    void ForEach(kvCallback callback) const
+    {
+        auto count { this->Data()->RecordCount };
+        auto records { this->Records() };
+
+        // Let the kernel read ahead aggressively while we stream.
+        madvise(this->DataMap, this->DataMapSize, MADV_SEQUENTIAL);
+
+        for (std::uint64_t i = 0; i < count; i++)
+        {
+            if (records[i].Erased)
+                continue;
+
+            if (!callback(records[i].Key, records[i].Value))
+                break;
+        }
+
+        madvise(this->DataMap, this->DataMapSize, MADV_NORMAL);
+    }
+
+    // Find the index of the node with the given key, counting only the
+    // items still in the map, or -1 if it is not present.
+    int FindIndex(const Key_t& key) const
+    {
+        auto slot { this->Slots()[this->FindSlot(key)] };
+        if (slot == EmptySlot)
+            return -1;
+
+        return static_cast<int>(this->LiveOrdinal(slot - 1));
+    }
+
+    // Set the value for the given key in the map and return its index.
+    std::size_t Set(const Key_t& key, const Value_t& value)
+    {
+        auto slot { this->FindSlot(key) };
+
+        // As with OrderedMap, an existing key keeps its value.
+        if (this->Slots()[slot] != EmptySlot)
+            return this->LiveOrdinal(this->Slots()[slot] - 1);
+
+        auto index { this->AppendRecord(key, value) };
+        this->Slots()[slot] = index + 1;
+        this->Index()->RecordCount++;
+
+        // Keep the index at most half full.
+        if (this->Index()->RecordCount * 2 > this->Index()->SlotCount)
+            this->RebuildIndex(this->Index()->SlotCount * 2);
+
+        // The new entry is the last live one.
+        return this->Data()->LiveCount - 1;
+    }
+
+    // Get the value for the given key in the map.
+    // The pointer is invalidated when the data file next grows.
+    Value_t* Get(const Key_t& key) const
+    {
+        auto slot { this->Slots()[this->FindSlot(key)] };
+        if (slot == EmptySlot)
+            return nullptr;
+
+        return &this->Records()[slot - 1].Value;
+    }
+
+    // Check if the map contains the given key.
+    bool Exists(const Key_t& key) const
+    {
+        return this->Slots()[this->FindSlot(key)] != EmptySlot;
+    }
+
+    // Remove the given key from the map. Returns true if it was present.
+    // Its entry is marked as erased and skipped until Compact() runs.
+    bool Erase(const Key_t& key)
+    {
+        auto slot { this->FindSlot(key) };
+        auto entry { this->Slots()[slot] };
+
+        if (entry == EmptySlot)
+            return false;
+
+        this->Records()[entry - 1].Erased = 1;
+        this->Data()->LiveCount--;
+        this->MarkTombstone(entry - 1);
+        this->RemoveSlot(slot);
+
+        return true;
+    }
+
+    // Using declaration for a function that takes a key and a value and returns a bool.
+    using KeyValuePredicate = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Remove, in a single pass over the data file, every pair for which the
+    // predicate returns true. Returns the number of pairs removed.
+    std::size_t EraseIf(const KeyValuePredicate& predicate)
+    {
+        auto count { this->Data()->RecordCount };
+        auto records { this->Records() };
+        std::size_t erased { 0 };
+
+        for (std::uint64_t i = 0; i < count; i++)
+        {
+            if (records[i].Erased || !predicate(records[i].Key, records[i].Value))
+                continue;
+
+            records[i].Erased = 1;
+            erased++;
+        }
+
+        if (erased == 0)
+            return 0;
+
+        // Cheaper to rebuild the index in one pass than to unpick it slot by slot.
+        this->Data()->LiveCount -= erased;
+        this->ResetTombstones();
+        this->RebuildIndex(this->Index()->SlotCount);
+
+        return erased;
+    }
+
+    // Drop erased entries from the data file, keeping the others in order,
+    // and shrink both files to fit. Invalidates indices and pointers.
+    void Compact()
+    {
+        auto header { this->Data() };
+        auto records { this->Records() };
+        std::uint64_t live { 0 };
+
+        for (std::uint64_t i = 0; i < header->RecordCount; i++)
+        {
+            if (records[i].Erased)
+                continue;
+
+            if (live != i)
+                records[live] = records[i];
+
+            live++;
+        }
+
+        auto capacity { InitialCapacity };
+        while (capacity < live)
+            capacity *= 2;
+
+        header->RecordCount = live;
+        header->LiveCount = live;
+        this->ResetTombstones();
+
+        MapFile(this->DataFile, this->DataMap, this->DataMapSize, DataSizeFor(capacity), MADV_NORMAL);
+        this->Data()->RecordCapacity = capacity;
+
+        this->RebuildIndex(SlotCountFor(live));
+    }
+};
+
+#endif // Foundation42_DiskOrderedMap_H
@@ -0,0 +1,278 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_MicroBenchmark_H
+#define Foundation42_MicroBenchmark_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "PerfCounters.h"
+
+// Class for running micro-benchmarks under hardware counters and reporting
+// the cost per operation. Each benchmark is run once to warm up and then a
+// number of times under PerfCounters; the median of each measure across
+// the repetitions is reported, so a single noisy run doesn't skew it.
+//
+//     MicroBenchmark bench;
+//     OrderedMap<int, int> map;
+//
+//     bench.Run("OrderedMap::Set", keys.size(),
+//               [&]() { map.Clear(); },
+//               [&]() { for (auto key : keys) map.Set(key, key); });
+//
+//     bench.WriteJson(std::cout);
+//
+// Only the calling thread is counted. When the counters are unavailable the
+// report carries wall-clock time alone and marks the rest as null.
+class MicroBenchmark
+{
+public:
+    // Structure for the result of one benchmark.
+    struct Result
+    {
+        std::string Name;
+        std::size_t Operations { 0 }; // Operations per repetition.
+        std::size_t Repetitions { 0 }; // Timed repetitions.
+        double Nanoseconds { 0 }; // Median wall-clock time per operation.
+        double PerOperation[PerfCounters::EventCount] {}; // Median count per operation.
+        bool Valid[PerfCounters::EventCount] {}; // Whether each count was measured.
+    };
+
+    // Using declaration for the code being measured, or its setup.
+    using Body = std::function<void ()>;
+
+private:
+    PerfCounters Counters; // Counters shared by every run.
+    std::size_t Repetitions; // Timed repetitions per benchmark.
+    std::vector<Result> Results; // Results in the order they were run.
+
+    // Get the median of the given values.
+    static double Median(std::vector<double> values)
+    {
+        if (values.empty())
+            return 0;
+
+        auto middle { values.begin() + values.size() / 2 };
+        std::nth_element(values.begin(), middle, values.end());
+        return *middle;
+    }
+
+    // Write the given string as a JSON string literal.
+    static void WriteString(std::ostream& stream, const std::string& text)
+    {
+        stream << '"';
+
+        for (auto c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                stream << "\\\"";
+                break;
+            case '\\':
+                stream << "\\\\";
+                break;
+            case '\n':
+                stream << "\\n";
+                break;
+            case '\t':
+                stream << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                    stream << escaped;
+                }
+                else
+                {
+                    stream << c;
+                }
+            }
+        }
+
+        stream << '"';
+    }
+
+public:
+    // Construct a harness that times each benchmark the given number of times.
+    explicit MicroBenchmark(std::size_t repetitions = 5) :
+        Repetitions(repetitions)
+    {
+        assert(repetitions > 0);
+    }
+
+    // Check if hardware counters could be opened. They may still never
+    // be scheduled; CountersMeasured says whether any count was taken.
+    bool CountersAvailable() const
+    {
+        return this->Counters.Available();
+    }
+
+    // Check if any result so far carries a hardware count, rather than
+    // the timer alone.
+    bool CountersMeasured() const
+    {
+        for (const auto& result : this->Results)
+        {
+            for (auto valid : result.Valid)
+            {
+                if (valid)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Keep the compiler from optimising away the given value.
+    template <typename Value_t>
+    static void Keep(const Value_t& value)
+    {
+#if defined(__GNUC__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    // Measure the given body, which performs the given number of
+    // operations. Setup runs untimed before each repetition, so that for
+    // example each run of Set starts from an empty map.
+    const Result& Run(const std::string& name, std::size_t operations, const Body& setup, const Body& body)
+    {
+        assert(operations > 0);
+
+        // Warm up caches, branch predictors and the allocator.
+        setup();
+        body();
+
+        std::vector<double> nanoseconds;
+        std::vector<double> counts[PerfCounters::EventCount];
+        PerfCounters::Sample sample;
+
+        for (std::size_t i = 0; i < this->Repetitions; i++)
+        {
+            setup();
+
+            this->Counters.Start();
+            body();
+            sample = this->Counters.Stop();
+
+            nanoseconds.push_back(sample.Nanoseconds);
+
+            for (int event = 0; event < PerfCounters::EventCount; event++)
+            {
+                if (sample.Valid[event])
+                    counts[event].push_back(sample.Values[event]);
+            }
+        }
+
+        Result result;
+        result.Name = name;
+        result.Operations = operations;
+        result.Repetitions = this->Repetitions;
+        result.Nanoseconds = Median(nanoseconds) / operations;
+
+        // A count is only reported if every repetition measured it.
+        for (int event = 0; event < PerfCounters::EventCount; event++)
+        {
+            result.Valid[event] = counts[event].size() == this->Repetitions;
+
+            if (result.Valid[event])
+                result.PerOperation[event] = Median(counts[event]) / operations;
+        }
+
+        this->Results.push_back(result);
+        return this->Results.back();
+    }
+
+    // Measure the given body with no setup.
+    const Result& Run(const std::string& name, std::size_t operations, const Body& body)
+    {
+        return this->Run(name, operations, []() {}, body);
+    }
+
+    // Get the results so far, in the order they were run.
+    const std::vector<Result>& GetResults() const
+    {
+        return this->Results;
+    }
+
+    // Forget the results so far.
+    void Clear()
+    {
+        this->Results.clear();
+    }
+
+    // Write the results as a JSON report. Counts that were not measured
+    // are written as null.
+    void WriteJson(std::ostream& stream) const
+    {
+        stream << "{\n  \"counters\": " << (this->CountersMeasured() ? "\"hardware\"" : "\"timer\"");
+        stream << ",\n  \"benchmarks\": [";
+
+        for (std::size_t i = 0; i < this->Results.size(); i++)
+        {
+            const auto& result { this->Results[i] };
+
+            stream << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+            WriteString(stream, result.Name);
+            stream << ", \"operations\": " << result.Operations;
+            stream << ", \"repetitions\": " << result.Repetitions;
+            stream << ", \"per_operation\": {\"nanoseconds\": " << result.Nanoseconds;
+
+            for (int event = 0; event < PerfCounters::EventCount; event++)
+            {
+                stream << ", \"" << PerfCounters::EventName(static_cast<PerfCounters::Event>(event)) << "\": ";
+
+                if (result.Valid[event])
+                    stream << result.PerOperation[event];
+                else
+                    stream << "null";
+            }
+
+            stream << "}}";
+        }
+
+        stream << (this->Results.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+
+    // Get the results as a JSON report.
+    std::string Json() const
+    {
+        std::ostringstream stream;
+        this->WriteJson(stream);
+        return stream.str();
+    }
+};
+
+#endif // Foundation42_MicroBenchmark_H
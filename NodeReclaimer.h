@@ -0,0 +1,201 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_NodeReclaimer_H
+#define Foundation42_NodeReclaimer_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+// Class that frees detached node chains away from the thread that dropped
+// them. Containers hand it their chain from Clear() in O(1) and the nodes
+// are then freed in bounded slices, either on a background thread or on
+// whichever thread calls ReclaimSome().
+//
+// The reclaimer must outlive every container attached to it, and any
+// allocator or memory resource used by those containers must outlive the
+// work it has queued.
+//
+// Nodes are only handed over if their allocator is ReclaimableAllocator,
+// since they are freed on another thread while the container goes on
+// allocating through the same allocator.
+// Trait for whether nodes from the given allocator may be freed on another
+// thread while their owner keeps allocating. True for std::allocator and
+// other stateless allocators, which use the thread-safe global heap. False
+// for std::pmr::polymorphic_allocator, since most memory resources (pools,
+// monotonic buffers, HugePageArena) are not thread-safe; specialise it to
+// true only if every resource in use is, such as
+// std::pmr::synchronized_pool_resource.
+template <typename Allocator_t>
+struct ReclaimableAllocator : std::allocator_traits<Allocator_t>::is_always_equal
+{
+};
+
+class NodeReclaimer
+{
+public:
+    // Using declaration for a unit of work. It frees at most budget nodes
+    // and returns true once there is nothing left to free.
+    using Task = std::function<bool (std::size_t budget)>;
+
+private:
+    std::deque<Task> Tasks; // Work waiting to be run.
+    mutable std::mutex Lock; // Guards the work queue.
+    std::condition_variable WorkReady; // Signalled when work is queued.
+    std::condition_variable WorkDone; // Signalled when a slice finishes.
+    std::size_t SliceSize { 0 }; // Nodes freed per slice on the background thread.
+    std::size_t Running { 0 }; // Number of tasks currently being run.
+    bool Stopping { false }; // Set when the background thread should exit.
+    std::thread Worker; // Background thread, if any.
+
+    // Run one slice of the task at the front of the queue.
+    // Returns false if the queue was empty.
+    bool RunSlice(std::unique_lock<std::mutex>& lock, std::size_t budget)
+    {
+        if (this->Tasks.empty())
+            return false;
+
+        auto task { std::move(this->Tasks.front()) };
+        this->Tasks.pop_front();
+        this->Running++;
+
+        // Free the nodes without holding the lock.
+        lock.unlock();
+        auto finished { task(budget) };
+        lock.lock();
+
+        // Unfinished work goes to the back so large chains don't starve small ones.
+        if (!finished)
+            this->Tasks.push_back(std::move(task));
+
+        this->Running--;
+        this->WorkDone.notify_all();
+
+        return true;
+    }
+
+    // Body of the background thread.
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock { this->Lock };
+
+        while (true)
+        {
+            this->WorkReady.wait(lock, [this]()
+            {
+                return this->Stopping || !this->Tasks.empty();
+            });
+
+            if (this->Tasks.empty())
+                break;
+
+            this->RunSlice(lock, this->SliceSize);
+        }
+    }
+
+public:
+    // Construct a reclaimer. With a background thread the queued work is
+    // freed sliceSize nodes at a time; without one nothing is freed until
+    // ReclaimSome() or Drain() is called.
+    explicit NodeReclaimer(bool background = true, std::size_t sliceSize = 4096) :
+        SliceSize(sliceSize)
+    {
+        assert(sliceSize > 0);
+
+        if (background)
+            this->Worker = std::thread([this]() { this->Run(); });
+    }
+
+    NodeReclaimer(const NodeReclaimer&) = delete;
+    NodeReclaimer& operator=(const NodeReclaimer&) = delete;
+
+    // Destructor. Frees any remaining work before returning.
+    ~NodeReclaimer()
+    {
+        if (this->Worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock { this->Lock };
+                this->Stopping = true;
+            }
+
+            this->WorkReady.notify_all();
+            this->Worker.join();
+        }
+
+        this->Drain();
+    }
+
+    // Queue the given work.
+    void Enqueue(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock { this->Lock };
+            this->Tasks.push_back(std::move(task));
+        }
+
+        this->WorkReady.notify_one();
+    }
+
+    // Free at most budget nodes on the calling thread.
+    // Returns true if no work is left queued.
+    bool ReclaimSome(std::size_t budget)
+    {
+        std::unique_lock<std::mutex> lock { this->Lock };
+        this->RunSlice(lock, budget);
+
+        return this->Tasks.empty();
+    }
+
+    // Free everything that has been queued, on the calling thread if needed,
+    // and wait for any slice in progress elsewhere to finish.
+    void Drain()
+    {
+        std::unique_lock<std::mutex> lock { this->Lock };
+
+        while (true)
+        {
+            if (this->RunSlice(lock, SIZE_MAX))
+                continue;
+
+            if (this->Running == 0)
+                break;
+
+            this->WorkDone.wait(lock);
+        }
+    }
+
+    // Get the number of detached chains still waiting to be freed.
+    std::size_t Pending() const
+    {
+        std::lock_guard<std::mutex> lock { this->Lock };
+        return this->Tasks.size() + this->Running;
+    }
+};
+
+#endif // Foundation42_NodeReclaimer_H
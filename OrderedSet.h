@@ -25,13 +25,14 @@
 #include <cstdint>
 #include <functional>
 #include <cassert>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
 
-#include <cstdint>
-#include <functional>
-#include <cassert>
+#include "NodeReclaimer.h"
 
 // Template class for an ordered set.
-template <typename Key_t>
+template <typename Key_t, typename Allocator_t = std::allocator<Key_t>>
 class OrderedSet
 {
 private:
@@ -42,15 +43,127 @@ private:
         Node* Next { nullptr };
     };
 
+    // Allocator types for nodes.
+    using NodeAllocator_t = typename std::allocator_traits<Allocator_t>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator_t>;
+
     mutable Node* Head { nullptr }; // Head of the set.
     std::size_t ItemCount { 0 }; // Number of items in the set.
+    NodeAllocator_t Allocator; // Allocator for nodes.
+    NodeReclaimer* Reclaimer { nullptr }; // Frees cleared nodes off this thread, if set.
+
+    // Allocate and construct a node.
+    Node* CreateNode()
+    {
+        auto node { NodeTraits::allocate(this->Allocator, 1) };
+
+        try
+        {
+            NodeTraits::construct(this->Allocator, node);
+        }
+        catch (...)
+        {
+            NodeTraits::deallocate(this->Allocator, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    // Destroy and deallocate a node.
+    void DestroyNode(Node* node)
+    {
+        NodeTraits::destroy(this->Allocator, node);
+        NodeTraits::deallocate(this->Allocator, node, 1);
+    }
+
+    // Kinds of merge that can be run over two sorted sets.
+    enum class MergeKind
+    {
+        Union,
+        Intersect,
+        Difference
+    };
+
+    // Walk this set and the other in step, passing each key that belongs in
+    // the result to the callback. Both sets must be in sorted order.
+    template <typename Callback_t>
+    void Merge(const OrderedSet& other, MergeKind kind, Callback_t&& callback) const
+    {
+        auto left { this->Head };
+        auto right { other.Head };
+
+        while (left != nullptr && right != nullptr)
+        {
+            if (left->Key < right->Key)
+            {
+                if (kind != MergeKind::Intersect)
+                    callback(left->Key);
+
+                left = left->Next;
+            }
+            else if (right->Key < left->Key)
+            {
+                if (kind == MergeKind::Union)
+                    callback(right->Key);
+
+                right = right->Next;
+            }
+            else
+            {
+                if (kind != MergeKind::Difference)
+                    callback(left->Key);
+
+                left = left->Next;
+                right = right->Next;
+            }
+        }
+
+        // Whatever is left of this set belongs to a union or difference.
+        for (; left != nullptr && kind != MergeKind::Intersect; left = left->Next)
+            callback(left->Key);
+
+        // Whatever is left of the other set belongs to a union.
+        for (; right != nullptr && kind == MergeKind::Union; right = right->Next)
+            callback(right->Key);
+    }
+
+    // Build a new set from a merge, appending each key at the tail.
+    OrderedSet MergeToSet(const OrderedSet& other, MergeKind kind) const
+    {
+        OrderedSet result { this->GetAllocator() };
+        Node* tail { nullptr };
+
+        this->Merge(other, kind, [&result, &tail](const Key_t& key)
+        {
+            auto node { result.CreateNode() };
+            node->Key = key;
+
+            if (tail == nullptr)
+                result.Head = node;
+            else
+                tail->Next = node;
+
+            tail = node;
+            result.ItemCount++;
+        });
+
+        return result;
+    }
 
 public:
     // Default constructor.
     OrderedSet() = default;
 
+    // Construct an empty set that allocates its nodes from the given allocator.
+    explicit OrderedSet(const Allocator_t& allocator) :
+        Allocator(allocator)
+    {
+    }
+
     // Copy constructor.
-    OrderedSet(const OrderedSet& other)
+    OrderedSet(const OrderedSet& other) :
+        Allocator(NodeTraits::select_on_container_copy_construction(other.Allocator))
     {
         // Copy each item from the other set.
         other.ForEach([this](const auto& lhs)
@@ -62,10 +175,13 @@ public:
 
     // Move constructor.
     OrderedSet(OrderedSet&& other) noexcept :
-        Head(std::move(other.Head)),
-        ItemCount(std::move(other.ItemCount))
+        Head(other.Head),
+        ItemCount(other.ItemCount),
+        Allocator(std::move(other.Allocator)),
+        Reclaimer(other.Reclaimer)
     {
-        // The assert(false) has been removed here.
+        other.Head = nullptr;
+        other.ItemCount = 0;
     }
 
     // Destructor.
@@ -81,15 +197,47 @@ public:
         return this->Head;
     }
 
+    // Use the given reclaimer to free nodes when the set is cleared or
+    // destroyed, or pass nullptr to free them synchronously again. Nodes
+    // from an allocator that is not ReclaimableAllocator, such as those of
+    // the pmr aliases, are always freed synchronously.
+    void SetReclaimer(NodeReclaimer* reclaimer)
+    {
+        this->Reclaimer = reclaimer;
+    }
+
     // Clear all items from the set.
     void Clear()
     {
+        // Hand the whole chain to the reclaimer if there is one and it may
+        // free through our allocator.
+        if (ReclaimableAllocator<NodeAllocator_t>::value && this->Reclaimer != nullptr && this->Head != nullptr)
+        {
+            this->Reclaimer->Enqueue([node = this->Head, allocator = this->Allocator](std::size_t budget) mutable
+            {
+                while (node != nullptr && budget > 0)
+                {
+                    auto next { node->Next };
+                    NodeTraits::destroy(allocator, node);
+                    NodeTraits::deallocate(allocator, node, 1);
+                    node = next;
+                    budget--;
+                }
+
+                return node == nullptr;
+            });
+
+            this->Head = nullptr;
+            this->ItemCount = 0;
+            return;
+        }
+
         Node* current { this->Head };
 
         while (current)
         {
             auto next { current->Next };
-            delete current;
+            this->DestroyNode(current);
             current = next;
         }
 
@@ -156,7 +304,7 @@ public:
         }
 
         // We couldn't find it, so create it here.
-        auto newNode { new Node() };
+        auto newNode { this->CreateNode() };
         newNode->Key = key;
 
         // If this is the first node, set it as the head.
@@ -220,7 +368,7 @@ public:
     // Free the given node.
     void FreeNode(Node* node)
     {
-        delete node;
+        this->DestroyNode(node);
     }
 
     // Add the given node to the front of the set.
@@ -248,7 +396,7 @@ public:
     // Insert the given key into the set in sorted order.
     void InsertSorted(const Key_t& key)
     {
-        auto node { new Node() };
+        auto node { this->CreateNode() };
         node->Key = key;
         this->InsertNodeSorted(node);
     }
@@ -284,34 +432,74 @@ public:
     // Using declaration for a function that takes a key and returns a bool.
     using KeyPredicate = std::function<bool (const Key_t& key)>;
 
-    // Delete nodes for which the predicate returns true.
-    void DeleteNodes(const KeyPredicate predicate)
+    // Remove the given key from the set. Returns true if it was present.
+    bool Erase(const Key_t& key)
+    {
+        Node* current { this->Head };
+        Node* previous { nullptr };
+    
+        while (current != nullptr)
+        {
+            if (current->Key == key)
+            {
+                if (previous == nullptr)
+                    this->Head = current->Next;
+                else
+                    previous->Next = current->Next;
+
+                this->DestroyNode(current);
+                this->ItemCount--;
+                return true;
+            }
+
+            previous = current;
+            current = current->Next;
+        }
+
+        return false;
+    }
+
+    // Remove, in a single pass, every key for which the predicate returns
+    // true. Returns the number of keys removed.
+    std::size_t EraseIf(const KeyPredicate& predicate)
     {
         Node* current { this->Head };
         Node* previous { nullptr };
+        std::size_t erased { 0 };
     
         while (current != nullptr)
         {
             if (predicate(current->Key))
             {
+                auto next { current->Next };
+
                 if (previous == nullptr)
                 {
-                    this->Head = nullptr;
+                    this->Head = next;
                 }
                 else
                 {
-                    previous->Next = current->Next;
+                    previous->Next = next;
                 }
 
-                current = current->Next;
-                delete current;
+                this->DestroyNode(current);
                 this->ItemCount--;
+                erased++;
+                current = next;
                 continue;
             }
 
             previous = current;
             current = current->Next;
         }
+
+        return erased;
+    }
+
+    // Delete nodes for which the predicate returns true.
+    void DeleteNodes(const KeyPredicate predicate)
+    {
+        this->EraseIf(predicate);
     }
 
     // Check if the set contains the given key.
@@ -321,6 +509,59 @@ public:
         return nodeIndex != -1;
     }
 
+    // Get the union of this set and the other, in sorted order.
+    // Both sets must be in sorted order, as built by InsertSorted.
+    OrderedSet Union(const OrderedSet& other) const
+    {
+        return this->MergeToSet(other, MergeKind::Union);
+    }
+
+    // Apply the given function to each key in the union, in sorted order.
+    void Union(const OrderedSet& other, keyCallback callback) const
+    {
+        this->Merge(other, MergeKind::Union, callback);
+    }
+
+    // Get the keys found in both this set and the other, in sorted order.
+    // Both sets must be in sorted order, as built by InsertSorted.
+    OrderedSet Intersect(const OrderedSet& other) const
+    {
+        return this->MergeToSet(other, MergeKind::Intersect);
+    }
+
+    // Apply the given function to each key in the intersection, in sorted order.
+    void Intersect(const OrderedSet& other, keyCallback callback) const
+    {
+        this->Merge(other, MergeKind::Intersect, callback);
+    }
+
+    // Get the keys in this set that are not in the other, in sorted order.
+    // Both sets must be in sorted order, as built by InsertSorted.
+    OrderedSet Difference(const OrderedSet& other) const
+    {
+        return this->MergeToSet(other, MergeKind::Difference);
+    }
+
+    // Apply the given function to each key in the difference, in sorted order.
+    void Difference(const OrderedSet& other, keyCallback callback) const
+    {
+        this->Merge(other, MergeKind::Difference, callback);
+    }
+
+    // Count the keys found in both this set and the other without building
+    // the intersection. Both sets must be in sorted order.
+    std::size_t IntersectCount(const OrderedSet& other) const
+    {
+        std::size_t count { 0 };
+
+        this->Merge(other, MergeKind::Intersect, [&count](const Key_t&)
+        {
+            count++;
+        });
+
+        return count;
+    }
+
     // Overloaded = operator for copying another set into this one.
     OrderedSet& operator=(const OrderedSet& other)
     {
@@ -338,17 +579,64 @@ public:
     }
 
     // Overloaded = operator for moving another set into this one.
-    OrderedSet& operator=(OrderedSet&& other) noexcept
+    OrderedSet& operator=(OrderedSet&& other)
+        noexcept(NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
     {
         assert(&other != this);
 
-        // Clear this set and then move the items from the other set.
+        // Clear this set first.
         this->Clear();
-        this->Head = std::move(other.Head);
-        this->ItemCount = std::move(other.ItemCount);
+
+        // Nodes can only be stolen if our allocator can free them.
+        if (NodeTraits::propagate_on_container_move_assignment::value ||
+            this->Allocator == other.Allocator)
+        {
+            if constexpr (NodeTraits::propagate_on_container_move_assignment::value)
+                this->Allocator = std::move(other.Allocator);
+
+            this->Head = other.Head;
+            this->ItemCount = other.ItemCount;
+            other.Head = nullptr;
+            other.ItemCount = 0;
+
+            return *this;
+        }
+
+        // Otherwise copy each item and release the other set.
+        other.ForEach([this](const auto& lhs)
+        {
+            this->Add(lhs);
+            return true;
+        });
+        other.Clear();
 
         return *this;
     }
+
+    // Get the allocator used by the set.
+    Allocator_t GetAllocator() const
+    {
+        return Allocator_t(this->Allocator);
+    }
+
+    // Forget every node without destroying or deallocating it. Only use
+    // this when the allocator's memory is reclaimed wholesale, such as a
+    // std::pmr::monotonic_buffer_resource that is about to be released.
+    void Release()
+    {
+        static_assert(std::is_trivially_destructible<Node>::value,
+                      "Release() would skip non-trivial destructors");
+
+        this->Head = nullptr;
+        this->ItemCount = 0;
+    }
 };
 
+namespace pmr
+{
+    // OrderedSet that allocates its nodes from a std::pmr::memory_resource.
+    template <typename Key_t>
+    using OrderedSet = ::OrderedSet<Key_t, std::pmr::polymorphic_allocator<Key_t>>;
+}
+
 #endif // Foundation42_OrderedSet_H
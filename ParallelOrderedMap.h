@@ -0,0 +1,253 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_ParallelOrderedMap_H
+#define Foundation42_ParallelOrderedMap_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "OrderedMap.h"
+#include "ThreadPool.h"
+
+// Class of parallel calls for OrderedMap, kept out of OrderedMap.h so that
+// only code that wants them pulls in the thread pool.
+//
+//     ThreadPool pool;
+//     auto map { ParallelOrderedMap::Build<int, int>(pool, pairs.begin(), pairs.end()) };
+//
+//     ParallelOrderedMap::ForEach(pool, map, [](const int& key, const int& value)
+//     {
+//         return true;
+//     });
+class ParallelOrderedMap
+{
+private:
+    // Split the map into runs of roughly equal length for parallel work.
+    // Returns the first node and length of each run, in map order.
+    template <typename Key_t, typename Value_t, typename Allocator_t>
+    static auto Partition(const OrderedMap<Key_t, Value_t, Allocator_t>& map, std::size_t partCount)
+    {
+        using Node = typename OrderedMap<Key_t, Value_t, Allocator_t>::Node;
+
+        std::vector<std::pair<Node*, std::size_t>> parts;
+
+        if (map.ItemCount == 0 || partCount == 0)
+            return parts;
+
+        auto partSize { (map.ItemCount + partCount - 1) / partCount };
+        Node* current { map.Head };
+        std::size_t index { 0 };
+
+        while (current)
+        {
+            if (index % partSize == 0)
+                parts.push_back({ current, 0 });
+
+            parts.back().second++;
+            current = current->Next;
+            index++;
+        }
+
+        return parts;
+    }
+
+public:
+    // Apply the given function to each key-value pair in the map, spread
+    // across the pool. Pairs are visited concurrently and in no particular
+    // order. Returning false from the function stops the traversal early.
+    template <typename Key_t, typename Value_t, typename Allocator_t>
+    static void ForEach(ThreadPool& pool, const OrderedMap<Key_t, Value_t, Allocator_t>& map,
+                        typename OrderedMap<Key_t, Value_t, Allocator_t>::kvCallback callback)
+    {
+        auto parts { Partition(map, pool.Size() * 4) };
+        std::atomic<bool> stopped { false };
+
+        pool.ParallelFor(parts.size(), [&parts, &stopped, &callback](std::size_t part)
+        {
+            auto current { parts[part].first };
+
+            for (std::size_t i = 0; i < parts[part].second && !stopped; i++)
+            {
+                if (!callback(current->Key, current->Value))
+                    stopped = true;
+
+                current = current->Next;
+            }
+        });
+    }
+
+    // Fold every key-value pair into a result, spread across the pool.
+    // Each run of the map starts from the identity and is folded in map
+    // order with accumulate; the partial results are then combined in map
+    // order, so combine need only be associative.
+    //
+    //     accumulate: Result_t (Result_t result, const Key_t& key, const Value_t& value)
+    //     combine: Result_t (Result_t lhs, Result_t rhs)
+    template <typename Result_t, typename Key_t, typename Value_t, typename Allocator_t,
+              typename Accumulate_t, typename Combine_t>
+    static Result_t Reduce(ThreadPool& pool, const OrderedMap<Key_t, Value_t, Allocator_t>& map, const Result_t& identity,
+                           Accumulate_t&& accumulate, Combine_t&& combine)
+    {
+        auto parts { Partition(map, pool.Size() * 4) };
+        std::vector<Result_t> partials(parts.size(), identity);
+
+        pool.ParallelFor(parts.size(), [&parts, &partials, &accumulate](std::size_t part)
+        {
+            auto current { parts[part].first };
+            auto result { partials[part] };
+
+            for (std::size_t i = 0; i < parts[part].second; i++)
+            {
+                result = accumulate(std::move(result), current->Key, current->Value);
+                current = current->Next;
+            }
+
+            partials[part] = std::move(result);
+        });
+
+        auto result { identity };
+
+        for (auto& partial : partials)
+            result = combine(std::move(result), std::move(partial));
+
+        return result;
+    }
+
+    // Build a map from a random-access range of key-value pairs, spread
+    // across the pool. As with Set, the first pair for a key wins and the
+    // map keeps the order in which keys first appear. Keys must work with
+    // std::hash, and the allocator must be safe to use from several threads.
+    template <typename Key_t, typename Value_t,
+              typename Allocator_t = std::allocator<std::pair<const Key_t, Value_t>>,
+              typename Iterator_t>
+    static OrderedMap<Key_t, Value_t, Allocator_t> Build(ThreadPool& pool, Iterator_t first, Iterator_t last,
+                                                         const Allocator_t& allocator = Allocator_t())
+    {
+        using Node = typename OrderedMap<Key_t, Value_t, Allocator_t>::Node;
+
+        OrderedMap<Key_t, Value_t, Allocator_t> result { allocator };
+
+        auto count { static_cast<std::size_t>(std::distance(first, last)) };
+        if (count == 0)
+            return result;
+
+        auto partCount { pool.Size() * 4 };
+        auto partSize { (count + partCount - 1) / partCount };
+        partCount = (count + partSize - 1) / partSize;
+
+        // Hash each run of the range, scattering its indices into one bucket
+        // per shard. Each shard owns the keys whose hash lands on it.
+        auto shardCount { pool.Size() };
+        std::vector<std::vector<std::vector<std::size_t>>> buckets(partCount, std::vector<std::vector<std::size_t>>(shardCount));
+
+        pool.ParallelFor(partCount, [&](std::size_t part)
+        {
+            auto end { std::min(count, (part + 1) * partSize) };
+
+            for (auto i = part * partSize; i < end; i++)
+                buckets[part][std::hash<Key_t>()(first[i].first) % shardCount].push_back(i);
+        });
+
+        // Each shard walks its buckets in run order, so it sees its keys in
+        // range order and marks the first pair for each of them.
+        std::vector<char> keep(count, 0);
+
+        pool.ParallelFor(shardCount, [&](std::size_t shard)
+        {
+            std::unordered_set<Key_t> seen;
+
+            for (std::size_t part = 0; part < partCount; part++)
+            {
+                for (auto i : buckets[part][shard])
+                    keep[i] = seen.insert(first[i].first).second;
+            }
+        });
+
+        // Build a chain per run of the range, then link the chains together.
+        std::vector<std::pair<Node*, Node*>> chains(partCount, { nullptr, nullptr });
+        std::vector<std::size_t> chainCounts(partCount, 0);
+
+        auto linkChains = [&result, &chains, &chainCounts]()
+        {
+            Node* tail { nullptr };
+
+            for (std::size_t part = 0; part < chains.size(); part++)
+            {
+                if (chains[part].first == nullptr)
+                    continue;
+
+                if (tail == nullptr)
+                    result.Head = chains[part].first;
+                else
+                    tail->Next = chains[part].first;
+
+                tail = chains[part].second;
+                result.ItemCount += chainCounts[part];
+            }
+        };
+
+        try
+        {
+            pool.ParallelFor(partCount, [&](std::size_t part)
+            {
+                auto end { std::min(count, (part + 1) * partSize) };
+
+                for (auto i = part * partSize; i < end; i++)
+                {
+                    if (!keep[i])
+                        continue;
+
+                    auto node { result.CreateNode() };
+                    node->Key = first[i].first;
+                    node->Value = first[i].second;
+
+                    if (chains[part].second == nullptr)
+                        chains[part].first = node;
+                    else
+                        chains[part].second->Next = node;
+
+                    chains[part].second = node;
+                    chainCounts[part]++;
+                }
+            });
+        }
+        catch (...)
+        {
+            // Link what was built so the result frees it.
+            linkChains();
+            throw;
+        }
+
+        linkChains();
+
+        return result;
+    }
+};
+
+#endif // Foundation42_ParallelOrderedMap_H
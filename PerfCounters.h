@@ -0,0 +1,278 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_PerfCounters_H
+#define Foundation42_PerfCounters_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Class for a set of hardware performance counters on the calling thread,
+// read through Linux perf_event_open. The counters are opened in small
+// groups of related events (cycles with instructions, the cache misses,
+// dTLB with branch misses) so that each group fits on the PMU and its
+// ratios are meaningful; one group of every event may never be scheduled
+// at all. Counters the machine or kernel will not give us (in a VM, or
+// with a restrictive perf_event_paranoid) are marked unavailable, and
+// wall-clock time is always measured, so a Sample is useful even with no
+// counters at all.
+class PerfCounters
+{
+public:
+    // Events that can be counted. Each consecutive pair is opened as one group.
+    enum Event
+    {
+        Cycles,
+        Instructions,
+        L1DMisses,
+        LLCMisses,
+        DTLBMisses,
+        BranchMisses,
+        EventCount
+    };
+
+    // Structure for the counts taken between Start and Stop.
+    struct Sample
+    {
+        double Values[EventCount] {}; // Counts, scaled up if their group was multiplexed.
+        bool Valid[EventCount] {}; // Whether each count was measured.
+        double Nanoseconds { 0 }; // Wall-clock time.
+    };
+
+    // Get the short name of the given event, as used in reports.
+    static const char* EventName(Event event)
+    {
+        static const char* names[EventCount] { "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses" };
+        return names[event];
+    }
+
+private:
+    static constexpr int GroupCount { 3 }; // Number of event groups.
+    static constexpr int GroupSize { 2 }; // Most events in one group.
+
+    // Structure for a group of events scheduled together.
+    struct Group
+    {
+        int Leader { -1 }; // Descriptor of the group leader, or -1.
+        Event Order[GroupSize]; // Events in the order the group reports them.
+        int OpenCount { 0 }; // Number of events in the group.
+    };
+
+    int Files[EventCount]; // Descriptor for each event, or -1.
+    Group Groups[GroupCount]; // Groups of related events.
+    std::chrono::steady_clock::time_point Started; // When Start was called.
+
+#if defined(__linux__)
+    // Open a counter for the given event, joining the given group if it
+    // has a leader.
+    int OpenEvent(Event event, int leader)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = leader < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // Cache events are encoded as cache | (operation << 8) | (result << 16).
+        auto cacheMiss = [](std::uint64_t cache)
+        {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+
+        switch (event)
+        {
+        case Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case L1DMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cacheMiss(PERF_COUNT_HW_CACHE_L1D);
+            break;
+        case LLCMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cacheMiss(PERF_COUNT_HW_CACHE_LL);
+            break;
+        case DTLBMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cacheMiss(PERF_COUNT_HW_CACHE_DTLB);
+            break;
+        case BranchMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            return -1;
+        }
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+    }
+
+    // Read the given group into the sample, if it was scheduled.
+    void ReadGroup(const Group& group, Sample& sample) const
+    {
+        // Layout of a group read: count, time enabled, time running, then the values.
+        std::uint64_t buffer[3 + GroupSize] {};
+        auto size { static_cast<ssize_t>((3 + group.OpenCount) * sizeof(std::uint64_t)) };
+
+        if (read(group.Leader, buffer, sizeof(buffer)) < size || buffer[0] != static_cast<std::uint64_t>(group.OpenCount))
+            return;
+
+        auto enabled { buffer[1] };
+        auto running { buffer[2] };
+
+        // A group that never got onto the PMU measured nothing.
+        if (running == 0)
+            return;
+
+        // Scale up if the group shared the PMU with other groups.
+        auto scale { static_cast<double>(enabled) / static_cast<double>(running) };
+
+        for (int i = 0; i < group.OpenCount; i++)
+        {
+            sample.Values[group.Order[i]] = static_cast<double>(buffer[3 + i]) * scale;
+            sample.Valid[group.Order[i]] = true;
+        }
+    }
+#endif
+
+public:
+    // Open as many of the counters as the machine allows.
+    PerfCounters()
+    {
+        for (auto& file : this->Files)
+            file = -1;
+
+#if defined(__linux__)
+        // Events are listed so that each consecutive pair forms a group.
+        static_assert(EventCount == GroupCount * GroupSize, "every event needs a group");
+
+        for (int event = 0; event < EventCount; event++)
+        {
+            auto& group { this->Groups[event / GroupSize] };
+
+            auto file { this->OpenEvent(static_cast<Event>(event), group.Leader) };
+            if (file < 0)
+                continue;
+
+            if (group.Leader < 0)
+                group.Leader = file;
+
+            this->Files[event] = file;
+            group.Order[group.OpenCount++] = static_cast<Event>(event);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Destructor.
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (auto file : this->Files)
+        {
+            if (file >= 0)
+                close(file);
+        }
+#endif
+    }
+
+    // Check if any hardware counter could be opened. An open counter may
+    // still never be scheduled; check Sample::Valid for what was measured.
+    bool Available() const
+    {
+        for (const auto& group : this->Groups)
+        {
+            if (group.Leader >= 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Check if the given event is being counted.
+    bool Available(Event event) const
+    {
+        return this->Files[event] >= 0;
+    }
+
+    // Reset the counters and start counting.
+    void Start()
+    {
+#if defined(__linux__)
+        for (const auto& group : this->Groups)
+        {
+            if (group.Leader < 0)
+                continue;
+
+            ioctl(group.Leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(group.Leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+
+        this->Started = std::chrono::steady_clock::now();
+    }
+
+    // Stop counting and return what was counted since Start.
+    Sample Stop()
+    {
+        auto stopped { std::chrono::steady_clock::now() };
+
+        Sample sample;
+        sample.Nanoseconds = std::chrono::duration<double, std::nano>(stopped - this->Started).count();
+
+#if defined(__linux__)
+        for (const auto& group : this->Groups)
+        {
+            if (group.Leader >= 0)
+                ioctl(group.Leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        for (const auto& group : this->Groups)
+        {
+            if (group.Leader >= 0)
+                this->ReadGroup(group, sample);
+        }
+#endif
+
+        return sample;
+    }
+};
+
+#endif // Foundation42_PerfCounters_H
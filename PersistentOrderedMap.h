@@ -0,0 +1,754 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_PersistentOrderedMap_H
+#define Foundation42_PersistentOrderedMap_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Template class for a persistent ordered map. Copies are O(1) and share
+// all of their structure; each Set copies only the path it changes, so the
+// memory held by a snapshot is proportional to the edits made since.
+//
+// Entries are kept in insertion order in a 32-way vector trie, and a hash
+// array mapped trie (HAMT) maps each key to its position in that order.
+// Both are immutable once built, so versions can be read from any thread.
+// Erasing a key removes it from the hash trie and marks its entry in the
+// order trie; the marked entries are dropped when they come to outnumber
+// the live ones, or by Compact(), which keeps every entry before the first
+// marked one shared with other versions.
+template <typename Key_t, typename Value_t>
+class PersistentOrderedMap
+{
+private:
+    static constexpr unsigned Bits { 5 }; // Bits of index or hash per level.
+    static constexpr std::size_t Width { 1u << Bits }; // Children per node.
+    static constexpr std::size_t Mask { Width - 1 }; // Mask for one level.
+
+    // Structure for an entry in the map.
+    struct Entry
+    {
+        Key_t Key;
+        Value_t Value;
+        bool Erased { false }; // Set once the entry has been erased.
+    };
+
+    // Structure for a node in the insertion-order trie. Leaves hold
+    // entries and branches hold children.
+    struct OrderNode
+    {
+        std::vector<std::shared_ptr<const OrderNode>> Children;
+        std::vector<Entry> Entries;
+        std::size_t Live { 0 }; // Number of entries below that are not erased.
+    };
+
+    // Structure for a node in the hash trie. Leaves hold every key with
+    // one full hash; branches hold a child for each set bit in Bitmap.
+    struct HashNode
+    {
+        bool IsLeaf { false };
+        std::size_t Hash { 0 };
+        std::vector<std::pair<Key_t, std::size_t>> Items;
+        std::uint32_t Bitmap { 0 };
+        std::vector<std::shared_ptr<const HashNode>> Children;
+    };
+
+    using OrderPtr = std::shared_ptr<const OrderNode>;
+    using HashPtr = std::shared_ptr<const HashNode>;
+
+    OrderPtr OrderRoot; // Root of the insertion-order trie.
+    unsigned OrderShift { 0 }; // Shift of the order root; zero when it is a leaf.
+    std::size_t OrderCount { 0 }; // Number of entries in the order trie, erased or not.
+    HashPtr HashRoot; // Root of the hash trie.
+    std::size_t ItemCount { 0 }; // Number of items in the map.
+
+    // Get the slot of the given bit among a branch's children.
+    static std::size_t ChildSlot(std::uint32_t bitmap, std::uint32_t bit)
+    {
+        return std::bitset<32>(bitmap & (bit - 1)).count();
+    }
+
+    // Make a hash leaf holding a single key.
+    static HashPtr MakeLeaf(std::size_t hash, const Key_t& key, std::size_t index)
+    {
+        auto leaf { std::make_shared<HashNode>() };
+        leaf->IsLeaf = true;
+        leaf->Hash = hash;
+        leaf->Items.push_back({ key, index });
+        return leaf;
+    }
+
+    // Make the branches needed to hold two leaves with different hashes.
+    static HashPtr MergeLeaves(const HashPtr& lhs, const HashPtr& rhs, unsigned shift)
+    {
+        auto branch { std::make_shared<HashNode>() };
+        auto lhsBit { std::uint32_t { 1 } << ((lhs->Hash >> shift) & Mask) };
+        auto rhsBit { std::uint32_t { 1 } << ((rhs->Hash >> shift) & Mask) };
+
+        // Same slot at this level: push both down a level.
+        if (lhsBit == rhsBit)
+        {
+            branch->Bitmap = lhsBit;
+            branch->Children.push_back(MergeLeaves(lhs, rhs, shift + Bits));
+            return branch;
+        }
+
+        branch->Bitmap = lhsBit | rhsBit;
+
+        if (lhsBit < rhsBit)
+            branch->Children = { lhs, rhs };
+        else
+            branch->Children = { rhs, lhs };
+
+        return branch;
+    }
+
+    // Return a copy of the hash trie with the given key added.
+    // The key must not already be present.
+    static HashPtr InsertHash(const HashPtr& node, std::size_t hash, unsigned shift,
+                              const Key_t& key, std::size_t index)
+    {
+        if (!node)
+            return MakeLeaf(hash, key, index);
+
+        if (node->IsLeaf)
+        {
+            // A full hash collision shares the leaf.
+            if (node->Hash == hash)
+            {
+                auto leaf { std::make_shared<HashNode>(*node) };
+                leaf->Items.push_back({ key, index });
+                return leaf;
+            }
+
+            return MergeLeaves(node, MakeLeaf(hash, key, index), shift);
+        }
+
+        auto bit { std::uint32_t { 1 } << ((hash >> shift) & Mask) };
+        auto slot { ChildSlot(node->Bitmap, bit) };
+        auto branch { std::make_shared<HashNode>(*node) };
+
+        if (node->Bitmap & bit)
+        {
+            branch->Children[slot] = InsertHash(node->Children[slot], hash, shift + Bits, key, index);
+        }
+        else
+        {
+            branch->Bitmap |= bit;
+            branch->Children.insert(branch->Children.begin() + slot, MakeLeaf(hash, key, index));
+        }
+
+        return branch;
+    }
+
+    // Return a copy of the hash trie with the given key removed, or null if
+    // nothing is left. The key must be present.
+    static HashPtr RemoveHash(const HashPtr& node, std::size_t hash, unsigned shift, const Key_t& key)
+    {
+        if (node->IsLeaf)
+        {
+            if (node->Items.size() == 1)
+                return nullptr;
+
+            auto leaf { std::make_shared<HashNode>(*node) };
+
+            for (auto item = leaf->Items.begin(); item != leaf->Items.end(); ++item)
+            {
+                if (item->first == key)
+                {
+                    leaf->Items.erase(item);
+                    break;
+                }
+            }
+
+            return leaf;
+        }
+
+        auto bit { std::uint32_t { 1 } << ((hash >> shift) & Mask) };
+        auto slot { ChildSlot(node->Bitmap, bit) };
+        auto child { RemoveHash(node->Children[slot], hash, shift + Bits, key) };
+        auto branch { std::make_shared<HashNode>(*node) };
+
+        if (child)
+        {
+            branch->Children[slot] = child;
+        }
+        else
+        {
+            branch->Bitmap &= ~bit;
+            branch->Children.erase(branch->Children.begin() + slot);
+        }
+
+        if (branch->Children.empty())
+            return nullptr;
+
+        // A lone leaf can move up; lookups check its full hash anyway.
+        if (branch->Children.size() == 1 && branch->Children.front()->IsLeaf)
+            return branch->Children.front();
+
+        return branch;
+    }
+
+    // Return a copy of the hash trie with the given key pointing at a new
+    // order index. The key must be present.
+    static HashPtr Reindex(const HashPtr& node, std::size_t hash, unsigned shift, const Key_t& key, std::size_t index)
+    {
+        auto copy { std::make_shared<HashNode>(*node) };
+
+        if (node->IsLeaf)
+        {
+            for (auto& item : copy->Items)
+            {
+                if (item.first == key)
+                    item.second = index;
+            }
+
+            return copy;
+        }
+
+        auto slot { ChildSlot(node->Bitmap, std::uint32_t { 1 } << ((hash >> shift) & Mask)) };
+        copy->Children[slot] = Reindex(node->Children[slot], hash, shift + Bits, key, index);
+
+        return copy;
+    }
+
+    // Find the order index of the given key, or -1 if it is not present.
+    std::ptrdiff_t FindOrder(const Key_t& key) const
+    {
+        auto hash { std::hash<Key_t>()(key) };
+        const HashNode* node { this->HashRoot.get() };
+        unsigned shift { 0 };
+
+        while (node != nullptr)
+        {
+            if (node->IsLeaf)
+            {
+                if (node->Hash != hash)
+                    return -1;
+
+                for (const auto& item : node->Items)
+                {
+                    if (item.first == key)
+                        return static_cast<std::ptrdiff_t>(item.second);
+                }
+
+                return -1;
+            }
+
+            auto bit { std::uint32_t { 1 } << ((hash >> shift) & Mask) };
+            if (!(node->Bitmap & bit))
+                return -1;
+
+            node = node->Children[ChildSlot(node->Bitmap, bit)].get();
+            shift += Bits;
+        }
+
+        return -1;
+    }
+
+    // Make a chain of order nodes down to a leaf holding the given live entry.
+    static OrderPtr NewPath(unsigned shift, const Entry& entry)
+    {
+        auto node { std::make_shared<OrderNode>() };
+        node->Live = 1;
+
+        if (shift == 0)
+            node->Entries.push_back(entry);
+        else
+            node->Children.push_back(NewPath(shift - Bits, entry));
+
+        return node;
+    }
+
+    // Return a copy of the order trie with the live entry appended at the given index.
+    static OrderPtr PushBack(const OrderPtr& node, unsigned shift, std::size_t index, const Entry& entry)
+    {
+        auto copy { std::make_shared<OrderNode>(*node) };
+        copy->Live++;
+
+        if (shift == 0)
+        {
+            copy->Entries.push_back(entry);
+            return copy;
+        }
+
+        auto child { (index >> shift) & Mask };
+
+        if (child < copy->Children.size())
+            copy->Children[child] = PushBack(copy->Children[child], shift - Bits, index, entry);
+        else
+            copy->Children.push_back(NewPath(shift - Bits, entry));
+
+        return copy;
+    }
+
+    // Return a copy of the order trie with the value at the given index replaced.
+    static OrderPtr Assign(const OrderPtr& node, unsigned shift, std::size_t index, const Value_t& value)
+    {
+        auto copy { std::make_shared<OrderNode>(*node) };
+
+        if (shift == 0)
+            copy->Entries[index & Mask].Value = value;
+        else
+            copy->Children[(index >> shift) & Mask] = Assign(node->Children[(index >> shift) & Mask], shift - Bits, index, value);
+
+        return copy;
+    }
+
+    // Return a copy of the order trie with the entry at the given index marked as erased.
+    static OrderPtr Bury(const OrderPtr& node, unsigned shift, std::size_t index)
+    {
+        auto copy { std::make_shared<OrderNode>(*node) };
+        copy->Live--;
+
+        if (shift == 0)
+            copy->Entries[index & Mask].Erased = true;
+        else
+            copy->Children[(index >> shift) & Mask] = Bury(node->Children[(index >> shift) & Mask], shift - Bits, index);
+
+        return copy;
+    }
+
+    // Return a copy of the order trie holding only its first count entries,
+    // which must be at least one. Full subtrees are shared, not copied.
+    static OrderPtr Truncate(const OrderPtr& node, unsigned shift, std::size_t count)
+    {
+        auto copy { std::make_shared<OrderNode>() };
+
+        if (shift == 0)
+        {
+            copy->Entries.assign(node->Entries.begin(), node->Entries.begin() + count);
+            copy->Live = static_cast<std::size_t>(std::count_if(copy->Entries.begin(), copy->Entries.end(), [](const Entry& entry)
+            {
+                return !entry.Erased;
+            }));
+
+            return copy;
+        }
+
+        auto last { (count - 1) >> shift };
+        auto remainder { count - (last << shift) };
+
+        copy->Children.assign(node->Children.begin(), node->Children.begin() + last);
+
+        if (remainder == (std::size_t { 1 } << shift))
+            copy->Children.push_back(node->Children[last]);
+        else
+            copy->Children.push_back(Truncate(node->Children[last], shift - Bits, remainder));
+
+        for (const auto& child : copy->Children)
+            copy->Live += child->Live;
+
+        return copy;
+    }
+
+    // Get the entry at the given order index.
+    const Entry& EntryAt(std::size_t index) const
+    {
+        const OrderNode* node { this->OrderRoot.get() };
+
+        for (auto shift = this->OrderShift; shift > 0; shift -= Bits)
+            node = node->Children[(index >> shift) & Mask].get();
+
+        return node->Entries[index & Mask];
+    }
+
+    // Visit the entries below the given order node in order. Returns false
+    // if the callback asked to stop.
+    template <typename Callback_t>
+    static bool Walk(const OrderNode* node, Callback_t& callback)
+    {
+        for (const auto& entry : node->Entries)
+        {
+            if (!entry.Erased && !callback(entry))
+                return false;
+        }
+
+        for (const auto& child : node->Children)
+        {
+            if (!Walk(child.get(), callback))
+                return false;
+        }
+
+        return true;
+    }
+
+    // Visit every entry below the given order node in order, erased or not.
+    template <typename Callback_t>
+    static void WalkAll(const OrderNode* node, Callback_t& callback)
+    {
+        for (const auto& entry : node->Entries)
+            callback(entry);
+
+        for (const auto& child : node->Children)
+            WalkAll(child.get(), callback);
+    }
+
+    // Append the given live entry to the order trie and return its order index.
+    std::size_t AppendOrder(const Entry& entry)
+    {
+        assert(!entry.Erased);
+
+        auto index { this->OrderCount };
+
+        if (!this->OrderRoot)
+        {
+            this->OrderRoot = NewPath(0, entry);
+        }
+        else if (index == (std::size_t { 1 } << (this->OrderShift + Bits)))
+        {
+            // The trie is full: grow a new root above it.
+            auto root { std::make_shared<OrderNode>() };
+            root->Children.push_back(this->OrderRoot);
+            root->Children.push_back(NewPath(this->OrderShift, entry));
+            root->Live = this->OrderRoot->Live + 1;
+
+            this->OrderRoot = root;
+            this->OrderShift += Bits;
+        }
+        else
+        {
+            this->OrderRoot = PushBack(this->OrderRoot, this->OrderShift, index, entry);
+        }
+
+        this->OrderCount++;
+        return index;
+    }
+
+    // Append a new entry, which must not already be present, and return
+    // its position among the live entries.
+    std::size_t Append(const Key_t& key, const Value_t& value)
+    {
+        auto index { this->AppendOrder({ key, value }) };
+
+        this->HashRoot = InsertHash(this->HashRoot, std::hash<Key_t>()(key), 0, key, index);
+
+        return this->ItemCount++;
+    }
+
+    // Get the position among the live entries of the entry at the given
+    // order index, by adding up the live counts of the subtrees to its left
+    // on the way down. Costs O(log n).
+    std::size_t LiveOrdinal(std::size_t index) const
+    {
+        if (this->OrderCount == this->ItemCount)
+            return index;
+
+        const OrderNode* node { this->OrderRoot.get() };
+        std::size_t ordinal { 0 };
+
+        for (auto shift = this->OrderShift; shift > 0; shift -= Bits)
+        {
+            auto child { (index >> shift) & Mask };
+
+            for (std::size_t i = 0; i < child; i++)
+                ordinal += node->Children[i]->Live;
+
+            node = node->Children[child].get();
+        }
+
+        for (std::size_t i = 0; i < (index & Mask); i++)
+        {
+            if (!node->Entries[i].Erased)
+                ordinal++;
+        }
+
+        return ordinal;
+    }
+
+    // Remove the given key, found at the given order index, without compacting.
+    void Remove(const Key_t& key, std::size_t index)
+    {
+        this->HashRoot = RemoveHash(this->HashRoot, std::hash<Key_t>()(key), 0, key);
+        this->OrderRoot = Bury(this->OrderRoot, this->OrderShift, index);
+        this->ItemCount--;
+    }
+
+    // Drop the erased entries once they outnumber the live ones, so scans
+    // stay proportional to the size of the map.
+    void CompactIfSparse()
+    {
+        if (this->OrderCount - this->ItemCount > this->ItemCount + Width)
+            this->Compact();
+    }
+
+public:
+    // Default constructor.
+    PersistentOrderedMap() = default;
+
+    // Copy constructor. Costs O(1); the copy shares all structure.
+    PersistentOrderedMap(const PersistentOrderedMap& other) = default;
+
+    // Move constructor.
+    PersistentOrderedMap(PersistentOrderedMap&& other) noexcept :
+        OrderRoot(std::move(other.OrderRoot)),
+        OrderShift(other.OrderShift),
+        OrderCount(other.OrderCount),
+        HashRoot(std::move(other.HashRoot)),
+        ItemCount(other.ItemCount)
+    {
+        other.OrderShift = 0;
+        other.OrderCount = 0;
+        other.ItemCount = 0;
+    }
+
+    // Clear all items from the map. Other versions are unaffected.
+    void Clear()
+    {
+        this->OrderRoot.reset();
+        this->OrderShift = 0;
+        this->OrderCount = 0;
+        this->HashRoot.reset();
+        this->ItemCount = 0;
+    }
+
+    // Get the number of items in the map.
+    std::size_t Count() const
+    {
+        return this->ItemCount;
+    }
+
+    // Using declaration for a function that takes a key.
+    using keyCallback = std::function<void (const Key_t& key)>;
+
+    // Apply the given function to each key in the map.
+    void ForEachKey(keyCallback callback) const
+    {
+        this->ForEach([&callback](const Key_t& key, const Value_t&)
+        {
+            callback(key);
+            return true;
+        });
+    }
+
+    // Using declaration for a function that takes a key and a value.
+    using kvCallback = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Apply the given function to each key-value pair in the map.
+    void ForEach(kvCallback callback) const
+    {
+        if (!this->OrderRoot)
+            return;
+
+        auto visit = [&callback](const Entry& entry)
+        {
+            return callback(entry.Key, entry.Value);
+        };
+
+        Walk(this->OrderRoot.get(), visit);
+    }
+
+    // Find the index of the node with the given key, counting only the
+    // items still in the map, or -1 if it is not present.
+    int FindIndex(const Key_t& key) const
+    {
+        auto index { this->FindOrder(key) };
+        if (index < 0)
+            return -1;
+
+        return static_cast<int>(this->LiveOrdinal(static_cast<std::size_t>(index)));
+    }
+
+    // Set the value for the given key in the map and return its index. As
+    // with OrderedMap, an existing key keeps its value; use Update to
+    // replace it.
+    std::size_t Set(const Key_t& key, const Value_t& value)
+    {
+        auto index { this->FindOrder(key) };
+        if (index >= 0)
+            return this->LiveOrdinal(static_cast<std::size_t>(index));
+
+        return this->Append(key, value);
+    }
+
+    // Set the value for the given key, replacing any existing value, and
+    // return its index.
+    std::size_t Update(const Key_t& key, const Value_t& value)
+    {
+        auto index { this->FindOrder(key) };
+        if (index < 0)
+            return this->Append(key, value);
+
+        this->OrderRoot = Assign(this->OrderRoot, this->OrderShift, static_cast<std::size_t>(index), value);
+        return this->LiveOrdinal(static_cast<std::size_t>(index));
+    }
+
+    // Get the value for the given key in the map. The pointer stays valid
+    // for as long as any version sharing it is alive.
+    const Value_t* Get(const Key_t& key) const
+    {
+        auto index { this->FindOrder(key) };
+        if (index < 0)
+            return nullptr;
+
+        return &this->EntryAt(static_cast<std::size_t>(index)).Value;
+    }
+
+    // Check if the map contains the given key.
+    bool Exists(const Key_t& key) const
+    {
+        return this->FindOrder(key) >= 0;
+    }
+
+    // Remove the given key from the map. Returns true if it was present.
+    // Other versions are unaffected.
+    bool Erase(const Key_t& key)
+    {
+        auto index { this->FindOrder(key) };
+        if (index < 0)
+            return false;
+
+        this->Remove(key, static_cast<std::size_t>(index));
+        this->CompactIfSparse();
+
+        return true;
+    }
+
+    // Using declaration for a function that takes a key and a value and returns a bool.
+    using KeyValuePredicate = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Remove every pair for which the predicate returns true. Returns the
+    // number of pairs removed. Each removal copies only its own paths, so
+    // other versions keep sharing the rest.
+    std::size_t EraseIf(const KeyValuePredicate& predicate)
+    {
+        std::vector<std::pair<Key_t, std::size_t>> doomed;
+        std::size_t index { 0 };
+
+        // Note the matches first; removing them replaces the tries being walked.
+        if (this->OrderRoot)
+        {
+            auto visit = [&doomed, &index, &predicate](const Entry& entry)
+            {
+                if (!entry.Erased && predicate(entry.Key, entry.Value))
+                    doomed.push_back({ entry.Key, index });
+
+                index++;
+                return true;
+            };
+
+            WalkAll(this->OrderRoot.get(), visit);
+        }
+
+        for (const auto& item : doomed)
+            this->Remove(item.first, item.second);
+
+        this->CompactIfSparse();
+
+        return doomed.size();
+    }
+
+    // Drop erased entries from the order trie, keeping the rest in order.
+    // Entries before the first erased one stay shared with other versions;
+    // the ones after it are moved down.
+    void Compact()
+    {
+        std::size_t first { 0 };
+
+        while (first < this->OrderCount && !this->EntryAt(first).Erased)
+            first++;
+
+        if (first == this->OrderCount)
+            return;
+
+        std::vector<Entry> moved;
+        moved.reserve(this->ItemCount - first);
+
+        for (auto i = first + 1; i < this->OrderCount; i++)
+        {
+            const auto& entry { this->EntryAt(i) };
+            if (!entry.Erased)
+                moved.push_back(entry);
+        }
+
+        // Cut the order trie back to the shared prefix.
+        if (first == 0)
+        {
+            this->OrderRoot.reset();
+            this->OrderShift = 0;
+        }
+        else
+        {
+            this->OrderRoot = Truncate(this->OrderRoot, this->OrderShift, first);
+
+            // Drop roots with a single child.
+            while (this->OrderShift > 0 && this->OrderRoot->Children.size() == 1)
+            {
+                this->OrderRoot = this->OrderRoot->Children.front();
+                this->OrderShift -= Bits;
+            }
+        }
+
+        this->OrderCount = first;
+
+        // Move the rest down and point their keys at their new places.
+        for (const auto& entry : moved)
+        {
+            auto index { this->AppendOrder(entry) };
+            this->HashRoot = Reindex(this->HashRoot, std::hash<Key_t>()(entry.Key), 0, entry.Key, index);
+        }
+    }
+
+    // Overloaded << operator for merging another map into this one.
+    PersistentOrderedMap& operator<<(const PersistentOrderedMap& other)
+    {
+        assert(&other != this);
+
+        // Merge each item from the other map into this one.
+        other.ForEach([this](const auto& lhs, const auto& rhs)
+        {
+            this->Set(lhs, rhs);
+            return true;
+        });
+
+        return *this;
+    }
+
+    // Overloaded = operator for copying another map into this one. Costs O(1).
+    PersistentOrderedMap& operator=(const PersistentOrderedMap& other) = default;
+
+    // Overloaded = operator for moving another map into this one.
+    PersistentOrderedMap& operator=(PersistentOrderedMap&& other) noexcept
+    {
+        assert(&other != this);
+
+        this->OrderRoot = std::move(other.OrderRoot);
+        this->OrderShift = other.OrderShift;
+        this->OrderCount = other.OrderCount;
+        this->HashRoot = std::move(other.HashRoot);
+        this->ItemCount = other.ItemCount;
+
+        other.OrderShift = 0;
+        other.OrderCount = 0;
+        other.ItemCount = 0;
+
+        return *this;
+    }
+};
+
+#endif // Foundation42_PersistentOrderedMap_H
@@ -25,9 +25,18 @@
 #include <cstdint>
 #include <functional>
 #include <cassert>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "NodeReclaimer.h"
+#include "SpaceSaving.h"
 
 // Template class for a probabilistic map.
-template <typename Key_t, typename Value_t>
+template <typename Key_t, typename Value_t,
+          typename Allocator_t = std::allocator<std::pair<const Key_t, Value_t>>>
 class ProbabalisticMap
 {
 private:
@@ -40,30 +49,81 @@ private:
         Node* Next { nullptr };
     };
 
+    // Allocator types for nodes.
+    using NodeAllocator_t = typename std::allocator_traits<Allocator_t>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator_t>;
+
     mutable Node* Head { nullptr }; // Head of the map.
     std::size_t ItemCount { 0 }; // Number of items in the map.
+    NodeAllocator_t Allocator; // Allocator for nodes.
+    NodeReclaimer* Reclaimer { nullptr }; // Frees cleared nodes off this thread, if set.
+    mutable std::unique_ptr<SpaceSaving<Key_t>> HeavyHitters; // Hottest keys, if tracked.
+
+    // Allocate and construct a node.
+    Node* CreateNode()
+    {
+        auto node { NodeTraits::allocate(this->Allocator, 1) };
+
+        try
+        {
+            NodeTraits::construct(this->Allocator, node);
+        }
+        catch (...)
+        {
+            NodeTraits::deallocate(this->Allocator, node, 1);
+            throw;
+        }
+
+        return node;
+    }
+
+    // Destroy and deallocate a node.
+    void DestroyNode(Node* node)
+    {
+        NodeTraits::destroy(this->Allocator, node);
+        NodeTraits::deallocate(this->Allocator, node, 1);
+    }
+
+    // Set the value for the given key without recording a hit, for
+    // copying and merging.
+    void Store(const Key_t& key, const Value_t& value)
+    {
+        auto node { this->FindOrCreate(key) };
+        node->Value = value;
+    }
 
 public:
     // Default constructor.
     ProbabalisticMap() = default;
 
+    // Construct an empty map that allocates its nodes from the given allocator.
+    explicit ProbabalisticMap(const Allocator_t& allocator) :
+        Allocator(allocator)
+    {
+    }
+
     // Copy constructor.
-    ProbabalisticMap(const ProbabalisticMap& other)
+    ProbabalisticMap(const ProbabalisticMap& other) :
+        Allocator(NodeTraits::select_on_container_copy_construction(other.Allocator))
     {
         // Copy each item from the other map.
         other.ForEach([this](const auto& lhs, const auto& rhs)
         {
-            this->Set(lhs, rhs);
+            this->Store(lhs, rhs);
             return true;
         });
     }
 
     // Move constructor.
     ProbabalisticMap(ProbabalisticMap&& other) noexcept :
-        Head(std::move(other.Head)),
-        ItemCount(std::move(other.ItemCount))
+        Head(other.Head),
+        ItemCount(other.ItemCount),
+        Allocator(std::move(other.Allocator)),
+        Reclaimer(other.Reclaimer),
+        HeavyHitters(std::move(other.HeavyHitters))
     {
-        // The assert(false) has been removed here.
+        other.Head = nullptr;
+        other.ItemCount = 0;
     }
 
     // Destructor.
@@ -73,15 +133,50 @@ public:
         this->Clear();
     }
 
+    // Use the given reclaimer to free nodes when the map is cleared or
+    // destroyed, or pass nullptr to free them synchronously again. Nodes
+    // from an allocator that is not ReclaimableAllocator, such as those of
+    // the pmr aliases, are always freed synchronously.
+    void SetReclaimer(NodeReclaimer* reclaimer)
+    {
+        this->Reclaimer = reclaimer;
+    }
+
     // Clear all items from the map.
     void Clear()
     {
+        if (this->HeavyHitters)
+            this->HeavyHitters->Clear();
+
+        // Hand the whole chain to the reclaimer if there is one and it may
+        // free through our allocator.
+        if (ReclaimableAllocator<NodeAllocator_t>::value && this->Reclaimer != nullptr && this->Head != nullptr)
+        {
+            this->Reclaimer->Enqueue([node = this->Head, allocator = this->Allocator](std::size_t budget) mutable
+            {
+                while (node != nullptr && budget > 0)
+                {
+                    auto next { node->Next };
+                    NodeTraits::destroy(allocator, node);
+                    NodeTraits::deallocate(allocator, node, 1);
+                    node = next;
+                    budget--;
+                }
+
+                return node == nullptr;
+            });
+
+            this->Head = nullptr;
+            this->ItemCount = 0;
+            return;
+        }
+
         Node* current { this->Head };
 
         while (current)
         {
             auto next { current->Next };
-            delete current;
+            this->DestroyNode(current);
             current = next;
         }
 
@@ -143,7 +238,7 @@ public:
     // Insert a new node with the given key at the front of the map.
     Node* PushNodeAtFront(const Key_t& key) 
     {
-        auto newNode { new Node() };
+        auto newNode { this->CreateNode() };
         newNode->Key = key;
         newNode->Next = this->Head;
         this->Head = newNode;
@@ -211,8 +306,10 @@ public:
     // Set the value for the given key in the map.
     void Set(const Key_t& key, const Value_t& value)
     {
-        auto node { this->FindOrCreate(key) };
-        node->Value = value;
+        this->Store(key, value);
+
+        if (this->HeavyHitters)
+            this->HeavyHitters->Record(key);
     }
 
     // Get the value for the given key in the map.
@@ -222,9 +319,103 @@ public:
         if (node == nullptr)
             return nullptr;
 
+        if (this->HeavyHitters)
+            this->HeavyHitters->Record(key);
+
         return &node->Value;
     }
 
+    // Remove the given key from the map. Returns true if it was present.
+    bool Erase(const Key_t& key)
+    {
+        Node* current { this->Head };
+        Node* previous { nullptr };
+    
+        while (current != nullptr)
+        {
+            if (current->Key == key)
+            {
+                if (previous == nullptr)
+                    this->Head = current->Next;
+                else
+                    previous->Next = current->Next;
+
+                if (this->HeavyHitters)
+                    this->HeavyHitters->Remove(key);
+
+                this->DestroyNode(current);
+                this->ItemCount--;
+                return true;
+            }
+
+            previous = current;
+            current = current->Next;
+        }
+
+        return false;
+    }
+
+    // Using declaration for a function that takes a key and a value and returns a bool.
+    using KeyValuePredicate = std::function<bool (const Key_t& key, const Value_t& value)>;
+
+    // Remove, in a single pass, every pair for which the predicate returns
+    // true. Returns the number of pairs removed.
+    std::size_t EraseIf(const KeyValuePredicate& predicate)
+    {
+        Node* current { this->Head };
+        Node* previous { nullptr };
+        std::size_t erased { 0 };
+    
+        while (current != nullptr)
+        {
+            auto next { current->Next };
+
+            if (predicate(current->Key, current->Value))
+            {
+                if (previous == nullptr)
+                    this->Head = next;
+                else
+                    previous->Next = next;
+
+                if (this->HeavyHitters)
+                    this->HeavyHitters->Remove(current->Key);
+
+                this->DestroyNode(current);
+                this->ItemCount--;
+                erased++;
+            }
+            else
+            {
+                previous = current;
+            }
+
+            current = next;
+        }
+
+        return erased;
+    }
+
+    // Start tracking the hottest keys seen by Get and Set, keeping at most
+    // the given number of counters. Tracking sits alongside the map and
+    // never changes its ordering. Pass zero to stop tracking.
+    void TrackHeavyHitters(std::size_t capacity)
+    {
+        if (capacity == 0)
+            this->HeavyHitters.reset();
+        else
+            this->HeavyHitters = std::make_unique<SpaceSaving<Key_t>>(capacity);
+    }
+
+    // Get up to k of the hottest tracked keys with their estimated hit
+    // counts, hottest first. Costs O(k), not a scan of the map.
+    std::vector<typename SpaceSaving<Key_t>::Entry> TopK(std::size_t k) const
+    {
+        if (!this->HeavyHitters)
+            return {};
+
+        return this->HeavyHitters->Top(k);
+    }
+
     // Overloaded << operator for merging another map into this one.
     ProbabalisticMap& operator<<(const ProbabalisticMap& other)
     {
@@ -233,7 +424,7 @@ public:
         // Merge each item from the other map into this one.
         other.ForEach([this](const auto& lhs, const auto& rhs)
         {
-            this->Set(lhs, rhs);
+            this->Store(lhs, rhs);
             return true;
         });
 
@@ -249,7 +440,7 @@ public:
         this->Clear();
         other.ForEach([this](const auto& lhs, const auto& rhs)
         {
-            this->Set(lhs, rhs);
+            this->Store(lhs, rhs);
             return true;
         });
 
@@ -257,17 +448,66 @@ public:
     }
 
     // Overloaded = operator for moving another map into this one.
-    ProbabalisticMap& operator=(ProbabalisticMap&& other) noexcept
+    ProbabalisticMap& operator=(ProbabalisticMap&& other)
+        noexcept(NodeTraits::propagate_on_container_move_assignment::value || NodeTraits::is_always_equal::value)
     {
         assert(&other != this);
 
-        // Clear this map and then move the items from the other map.
+        // Clear this map first.
         this->Clear();
-        this->Head = std::move(other.Head);
-        this->ItemCount = std::move(other.ItemCount);
+
+        // Nodes can only be stolen if our allocator can free them.
+        if (NodeTraits::propagate_on_container_move_assignment::value ||
+            this->Allocator == other.Allocator)
+        {
+            if constexpr (NodeTraits::propagate_on_container_move_assignment::value)
+                this->Allocator = std::move(other.Allocator);
+
+            this->Head = other.Head;
+            this->ItemCount = other.ItemCount;
+            this->HeavyHitters = std::move(other.HeavyHitters);
+            other.Head = nullptr;
+            other.ItemCount = 0;
+
+            return *this;
+        }
+
+        // Otherwise copy each item and release the other map.
+        other.ForEach([this](const auto& lhs, const auto& rhs)
+        {
+            this->Store(lhs, rhs);
+            return true;
+        });
+        this->HeavyHitters = std::move(other.HeavyHitters);
+        other.Clear();
 
         return *this;
     }
+
+    // Get the allocator used by the map.
+    Allocator_t GetAllocator() const
+    {
+        return Allocator_t(this->Allocator);
+    }
+
+    // Forget every node without destroying or deallocating it. Only use
+    // this when the allocator's memory is reclaimed wholesale, such as a
+    // std::pmr::monotonic_buffer_resource that is about to be released.
+    void Release()
+    {
+        static_assert(std::is_trivially_destructible<Node>::value,
+                      "Release() would skip non-trivial destructors");
+
+        this->Head = nullptr;
+        this->ItemCount = 0;
+    }
 };
 
+namespace pmr
+{
+    // ProbabalisticMap that allocates its nodes from a std::pmr::memory_resource.
+    template <typename Key_t, typename Value_t>
+    using ProbabalisticMap = ::ProbabalisticMap<Key_t, Value_t, std::pmr::polymorphic_allocator<std::pair<const Key_t, Value_t>>>;
+}
+
 #endif // Foundation42_ProbabalisticMap_H
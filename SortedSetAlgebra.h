@@ -0,0 +1,420 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_SortedSetAlgebra_H
+#define Foundation42_SortedSetAlgebra_H
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Set algebra over strictly increasing arrays of keys, such as the keys of
+// a sorted OrderedSet copied out into a contiguous buffer. Results are
+// written to a caller-supplied buffer and the number written is returned,
+// so nothing is allocated per element.
+//
+// When one input is much smaller than the other, each of its keys is found
+// in the larger one by galloping search. For 32-bit integer keys on SSE2
+// targets, balanced intersections compare four keys against four at a time.
+//
+// Keys that are interleaved with other data, such as the nodes of a
+// compacted CompactOrderedSet, can be passed as StridedKeys instead.
+class SortedSetAlgebra
+{
+public:
+    // View of keys spaced Stride bytes apart. The Stride bytes starting at
+    // each key must be readable, since the SIMD path loads whole records.
+    template <typename Key_t, std::size_t Stride>
+    struct StridedKeys
+    {
+        const unsigned char* Base; // Address of the first key.
+
+        // Get the key at the given position.
+        const Key_t& operator[](std::size_t index) const
+        {
+            return *reinterpret_cast<const Key_t*>(this->Base + index * Stride);
+        }
+    };
+
+private:
+    // Size ratio above which galloping beats a linear merge.
+    static constexpr std::size_t GallopRatio { 32 };
+
+    // Whether the SIMD block intersection applies to a kind of key array.
+    template <typename Keys_t>
+    struct SimdKeys : std::false_type
+    {
+    };
+
+#if defined(__SSE2__)
+    // Plain arrays of 32-bit integers.
+    template <typename Key_t>
+    struct SimdKeys<const Key_t*> : std::bool_constant<std::is_integral<Key_t>::value && sizeof(Key_t) == 4>
+    {
+    };
+
+    // 32-bit integers each followed by four other bytes.
+    template <typename Key_t>
+    struct SimdKeys<StridedKeys<Key_t, 8>> : std::bool_constant<std::is_integral<Key_t>::value && sizeof(Key_t) == 4>
+    {
+    };
+
+    // Load the four keys starting at the given position.
+    template <typename Key_t>
+    static __m128i LoadBlock(const Key_t* keys, std::size_t index)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + index));
+    }
+
+    // Load the four keys starting at the given position, picking them out
+    // of two loads of two records each.
+    template <typename Key_t>
+    static __m128i LoadBlock(const StridedKeys<Key_t, 8>& keys, std::size_t index)
+    {
+        auto low { _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys.Base + index * 8))) };
+        auto high { _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys.Base + index * 8 + 16))) };
+
+        return _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+#endif
+
+    // Find the first position at or after start whose key is not less than
+    // the given key, by doubling the step and then binary searching.
+    template <typename Keys_t, typename Key_t>
+    static std::size_t Gallop(const Keys_t& keys, std::size_t start, std::size_t count, const Key_t& key)
+    {
+        std::size_t step { 1 };
+        std::size_t low { start };
+        std::size_t high { start };
+
+        // Double the step until we pass the key or run out of keys.
+        while (high < count && keys[high] < key)
+        {
+            low = high + 1;
+            high = start + step;
+            step <<= 1;
+        }
+
+        if (high > count)
+            high = count;
+
+        // Binary search the last step.
+        while (low < high)
+        {
+            auto middle { low + (high - low) / 2 };
+
+            if (keys[middle] < key)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        return low;
+    }
+
+    // Intersect a small array with a much larger one by galloping through
+    // the larger. Keys are taken from the small array.
+    template <typename Keys_t, typename Callback_t>
+    static void GallopIntersect(const Keys_t& small, std::size_t smallCount,
+                                const Keys_t& large, std::size_t largeCount,
+                                Callback_t&& callback)
+    {
+        std::size_t position { 0 };
+
+        for (std::size_t i = 0; i < smallCount && position < largeCount; i++)
+        {
+            position = Gallop(large, position, largeCount, small[i]);
+
+            if (position < largeCount && !(small[i] < large[position]))
+                callback(small[i]);
+        }
+    }
+
+    // Intersect two arrays with a linear merge, starting at the given positions.
+    template <typename Keys_t, typename Callback_t>
+    static void MergeIntersect(const Keys_t& left, std::size_t i, std::size_t leftCount,
+                               const Keys_t& right, std::size_t j, std::size_t rightCount,
+                               Callback_t&& callback)
+    {
+        while (i < leftCount && j < rightCount)
+        {
+            if (left[i] < right[j])
+            {
+                i++;
+            }
+            else if (right[j] < left[i])
+            {
+                j++;
+            }
+            else
+            {
+                callback(left[i]);
+                i++;
+                j++;
+            }
+        }
+    }
+
+    // Intersect two arrays of 32-bit keys, comparing a block of four keys
+    // from each side at once, then finish the tails with a linear merge.
+    template <typename Keys_t, typename Callback_t>
+    static void SimdIntersect(const Keys_t& left, std::size_t leftCount,
+                              const Keys_t& right, std::size_t rightCount,
+                              Callback_t&& callback)
+    {
+        std::size_t i { 0 };
+        std::size_t j { 0 };
+
+#if defined(__SSE2__)
+        while (i + 4 <= leftCount && j + 4 <= rightCount)
+        {
+            auto a { LoadBlock(left, i) };
+            auto b { LoadBlock(right, j) };
+
+            // Compare each left key against all four rotations of the right block.
+            auto matches { _mm_cmpeq_epi32(a, b) };
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, 0x39)));
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, 0x4E)));
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, 0x93)));
+
+            auto mask { _mm_movemask_ps(_mm_castsi128_ps(matches)) };
+
+            for (auto k = 0; k < 4; k++)
+            {
+                if (mask & (1 << k))
+                    callback(left[i + k]);
+            }
+
+            // Advance whichever block ends first, or both if they end together.
+            auto leftLast { left[i + 3] };
+            auto rightLast { right[j + 3] };
+
+            if (!(rightLast < leftLast))
+                i += 4;
+
+            if (!(leftLast < rightLast))
+                j += 4;
+        }
+#endif
+
+        MergeIntersect(left, i, leftCount, right, j, rightCount, callback);
+    }
+
+    // Pass each key found in both arrays to the callback, in order,
+    // choosing between galloping, SIMD and a linear merge.
+    template <typename Keys_t, typename Callback_t>
+    static void IntersectKeys(const Keys_t& left, std::size_t leftCount,
+                              const Keys_t& right, std::size_t rightCount,
+                              Callback_t&& callback)
+    {
+        if (leftCount * GallopRatio < rightCount)
+            GallopIntersect(left, leftCount, right, rightCount, callback);
+        else if (rightCount * GallopRatio < leftCount)
+            GallopIntersect(right, rightCount, left, leftCount, callback);
+        else if constexpr (SimdKeys<Keys_t>::value)
+            SimdIntersect(left, leftCount, right, rightCount, callback);
+        else
+            MergeIntersect(left, 0, leftCount, right, 0, rightCount, callback);
+    }
+
+    // Pass each key in the left array that is not in the right one to the
+    // callback, in order.
+    template <typename Keys_t, typename Callback_t>
+    static void DifferenceKeys(const Keys_t& left, std::size_t leftCount,
+                               const Keys_t& right, std::size_t rightCount,
+                               Callback_t&& callback)
+    {
+        // A small left side only needs to probe the right side.
+        if (leftCount * GallopRatio < rightCount)
+        {
+            std::size_t position { 0 };
+
+            for (std::size_t i = 0; i < leftCount; i++)
+            {
+                position = Gallop(right, position, rightCount, left[i]);
+
+                if (position == rightCount || left[i] < right[position])
+                    callback(left[i]);
+            }
+
+            return;
+        }
+
+        std::size_t i { 0 };
+        std::size_t j { 0 };
+
+        while (i < leftCount && j < rightCount)
+        {
+            if (left[i] < right[j])
+            {
+                callback(left[i++]);
+            }
+            else if (right[j] < left[i])
+            {
+                j++;
+            }
+            else
+            {
+                i++;
+                j++;
+            }
+        }
+
+        while (i < leftCount)
+            callback(left[i++]);
+    }
+
+public:
+    // Apply the given function to each key found in both arrays, in order.
+    template <typename Key_t, typename Callback_t>
+    static void Intersect(const Key_t* left, std::size_t leftCount,
+                          const Key_t* right, std::size_t rightCount,
+                          Callback_t&& callback)
+    {
+        IntersectKeys(left, leftCount, right, rightCount, callback);
+    }
+
+    // Apply the given function to each key found in both strided views, in order.
+    template <typename Key_t, std::size_t Stride, typename Callback_t>
+    static void Intersect(const StridedKeys<Key_t, Stride>& left, std::size_t leftCount,
+                          const StridedKeys<Key_t, Stride>& right, std::size_t rightCount,
+                          Callback_t&& callback)
+    {
+        IntersectKeys(left, leftCount, right, rightCount, callback);
+    }
+
+    // Write the keys found in both arrays to the output, which must have
+    // room for the smaller of the two counts. Returns the number written.
+    template <typename Key_t>
+    static std::size_t Intersect(const Key_t* left, std::size_t leftCount,
+                                 const Key_t* right, std::size_t rightCount,
+                                 Key_t* output)
+    {
+        std::size_t written { 0 };
+
+        IntersectKeys(left, leftCount, right, rightCount, [output, &written](const Key_t& key)
+        {
+            output[written++] = key;
+        });
+
+        return written;
+    }
+
+    // Count the keys found in both arrays.
+    template <typename Key_t>
+    static std::size_t IntersectCount(const Key_t* left, std::size_t leftCount,
+                                      const Key_t* right, std::size_t rightCount)
+    {
+        std::size_t count { 0 };
+
+        IntersectKeys(left, leftCount, right, rightCount, [&count](const Key_t&)
+        {
+            count++;
+        });
+
+        return count;
+    }
+
+    // Count the keys found in both strided views.
+    template <typename Key_t, std::size_t Stride>
+    static std::size_t IntersectCount(const StridedKeys<Key_t, Stride>& left, std::size_t leftCount,
+                                      const StridedKeys<Key_t, Stride>& right, std::size_t rightCount)
+    {
+        std::size_t count { 0 };
+
+        IntersectKeys(left, leftCount, right, rightCount, [&count](const Key_t&)
+        {
+            count++;
+        });
+
+        return count;
+    }
+
+    // Write the keys found in either array to the output, which must have
+    // room for both counts together. Returns the number written.
+    template <typename Key_t>
+    static std::size_t Union(const Key_t* left, std::size_t leftCount,
+                             const Key_t* right, std::size_t rightCount,
+                             Key_t* output)
+    {
+        std::size_t i { 0 };
+        std::size_t j { 0 };
+        std::size_t written { 0 };
+
+        while (i < leftCount && j < rightCount)
+        {
+            if (left[i] < right[j])
+            {
+                output[written++] = left[i++];
+            }
+            else if (right[j] < left[i])
+            {
+                output[written++] = right[j++];
+            }
+            else
+            {
+                output[written++] = left[i++];
+                j++;
+            }
+        }
+
+        while (i < leftCount)
+            output[written++] = left[i++];
+
+        while (j < rightCount)
+            output[written++] = right[j++];
+
+        return written;
+    }
+
+    // Write the keys in the left array that are not in the right one to the
+    // output, which must have room for the left count. Returns the number written.
+    template <typename Key_t>
+    static std::size_t Difference(const Key_t* left, std::size_t leftCount,
+                                  const Key_t* right, std::size_t rightCount,
+                                  Key_t* output)
+    {
+        std::size_t written { 0 };
+
+        DifferenceKeys(left, leftCount, right, rightCount, [output, &written](const Key_t& key)
+        {
+            output[written++] = key;
+        });
+
+        return written;
+    }
+
+    // Apply the given function to each key in the left strided view that is
+    // not in the right one, in order.
+    template <typename Key_t, std::size_t Stride, typename Callback_t>
+    static void Difference(const StridedKeys<Key_t, Stride>& left, std::size_t leftCount,
+                           const StridedKeys<Key_t, Stride>& right, std::size_t rightCount,
+                           Callback_t&& callback)
+    {
+        DifferenceKeys(left, leftCount, right, rightCount, callback);
+    }
+};
+
+#endif // Foundation42_SortedSetAlgebra_H
@@ -0,0 +1,220 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_SpaceSaving_H
+#define Foundation42_SpaceSaving_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Template class for a Space-Saving heavy-hitter summary. It keeps at most
+// Capacity counters; when a new key arrives and the summary is full, the
+// key with the smallest count is evicted and the newcomer inherits its
+// count. Any key seen more than Total / Capacity times is guaranteed to be
+// present, and each estimate overcounts by at most its Error.
+//
+// Entries are kept in a Stream-Summary: one bucket per distinct count, in
+// count order, each holding the entries with that count. A hit moves an
+// entry to the next bucket in O(1) amortised, and Top(k) reads the k
+// hottest entries off the high end in O(k).
+template <typename Key_t>
+class SpaceSaving
+{
+public:
+    // Structure for a tracked key.
+    struct Entry
+    {
+        Key_t Key;
+        std::size_t Count { 0 }; // Estimated number of hits.
+        std::size_t Error { 0 }; // Most the estimate can overcount by.
+    };
+
+private:
+    using Bucket = std::list<Entry>;
+    using Buckets_t = std::map<std::size_t, Bucket>;
+
+    // Structure for where a tracked key lives.
+    struct Position
+    {
+        typename Buckets_t::iterator Owner; // Bucket holding the entry.
+        typename Bucket::iterator Item; // The entry itself.
+    };
+
+    Buckets_t Buckets; // Entries grouped by count, lowest first.
+    std::unordered_map<Key_t, Position> Positions; // Where each key lives.
+    std::size_t Capacity { 0 }; // Maximum number of tracked keys.
+    std::size_t Total { 0 }; // Number of hits recorded.
+    std::size_t Floor { 0 }; // Largest count ever evicted.
+
+    // Move the entry at the given position to the bucket for the given
+    // count, which must be higher than its current one.
+    void Promote(Position& position, std::size_t count)
+    {
+        auto next { std::next(position.Owner) };
+
+        if (next == this->Buckets.end() || next->first != count)
+            next = this->Buckets.emplace_hint(next, count, Bucket {});
+
+        next->second.splice(next->second.end(), position.Owner->second, position.Item);
+        position.Item->Count = count;
+
+        if (position.Owner->second.empty())
+            this->Buckets.erase(position.Owner);
+
+        position.Owner = next;
+    }
+
+    // Start tracking the given key. Any key that is not tracked may have
+    // been counted up to Floor times before, so it starts just above it.
+    void Track(const Key_t& key)
+    {
+        auto count { this->Floor + 1 };
+        auto owner { this->Buckets.emplace(count, Bucket {}).first };
+
+        owner->second.push_back({ key, count, this->Floor });
+        this->Positions[key] = { owner, std::prev(owner->second.end()) };
+    }
+
+    // Stop tracking the entry at the given position.
+    void Drop(const Position& position)
+    {
+        position.Owner->second.erase(position.Item);
+
+        if (position.Owner->second.empty())
+            this->Buckets.erase(position.Owner);
+    }
+
+public:
+    // Construct a summary that tracks at most the given number of keys.
+    explicit SpaceSaving(std::size_t capacity) :
+        Capacity(capacity)
+    {
+        assert(capacity > 0);
+
+        this->Positions.reserve(capacity);
+    }
+
+    // Positions point into our own buckets, so a copy would dangle.
+    SpaceSaving(const SpaceSaving&) = delete;
+    SpaceSaving& operator=(const SpaceSaving&) = delete;
+
+    // Record a hit for the given key. Costs O(1) amortised for a tracked
+    // key and O(log buckets) for a new one.
+    void Record(const Key_t& key)
+    {
+        this->Total++;
+
+        // Already tracked: bump its count.
+        auto position { this->Positions.find(key) };
+
+        if (position != this->Positions.end())
+        {
+            this->Promote(position->second, position->second.Item->Count + 1);
+            return;
+        }
+
+        // Full: evict the key with the smallest count. Its count may hold
+        // hits of keys evicted before it, so newcomers start above it.
+        if (this->Positions.size() == this->Capacity)
+        {
+            auto smallest { this->Positions.find(this->Buckets.begin()->second.front().Key) };
+            this->Floor = std::max(this->Floor, smallest->second.Item->Count);
+            this->Drop(smallest->second);
+            this->Positions.erase(smallest);
+        }
+
+        this->Track(key);
+    }
+
+    // Stop tracking the given key, if it is tracked, forgetting its hits.
+    // Its count hides no other key's hits, so the floor is unchanged and
+    // keys that arrive later do not start above the remaining ones.
+    void Remove(const Key_t& key)
+    {
+        auto position { this->Positions.find(key) };
+
+        if (position == this->Positions.end())
+            return;
+
+        this->Drop(position->second);
+        this->Positions.erase(position);
+    }
+
+    // Forget every tracked key.
+    void Clear()
+    {
+        this->Buckets.clear();
+        this->Positions.clear();
+        this->Total = 0;
+        this->Floor = 0;
+    }
+
+    // Get the number of hits recorded.
+    std::size_t TotalCount() const
+    {
+        return this->Total;
+    }
+
+    // Get the number of tracked keys.
+    std::size_t Count() const
+    {
+        return this->Positions.size();
+    }
+
+    // Using declaration for a function that takes a tracked entry.
+    using entryCallback = std::function<void (const Entry& entry)>;
+
+    // Apply the given function to each tracked entry, lowest count first.
+    void ForEach(entryCallback callback) const
+    {
+        for (const auto& bucket : this->Buckets)
+        {
+            for (const auto& entry : bucket.second)
+                callback(entry);
+        }
+    }
+
+    // Get up to k tracked entries with the highest counts, hottest first.
+    // Costs O(k).
+    std::vector<Entry> Top(std::size_t k) const
+    {
+        std::vector<Entry> top;
+        top.reserve(std::min(k, this->Positions.size()));
+
+        for (auto bucket = this->Buckets.rbegin(); bucket != this->Buckets.rend() && top.size() < k; ++bucket)
+        {
+            for (auto entry = bucket->second.begin(); entry != bucket->second.end() && top.size() < k; ++entry)
+                top.push_back(*entry);
+        }
+
+        return top;
+    }
+};
+
+#endif // Foundation42_SpaceSaving_H
@@ -0,0 +1,237 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+#ifndef Foundation42_ThreadPool_H
+#define Foundation42_ThreadPool_H
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Class for a fixed pool of worker threads with work stealing. Each worker
+// owns a queue; it takes work from the front of its own queue and, when
+// that runs dry, steals from the back of another worker's queue.
+class ThreadPool
+{
+public:
+    // Using declaration for a unit of work.
+    using Job = std::function<void ()>;
+
+private:
+    // Structure for a worker's queue of jobs.
+    struct Queue
+    {
+        std::deque<Job> Jobs;
+        std::mutex Lock;
+    };
+
+    std::vector<std::unique_ptr<Queue>> Queues; // One queue per worker.
+    std::vector<std::thread> Workers; // Worker threads.
+    std::atomic<std::size_t> NextQueue { 0 }; // Round-robin target for Submit().
+    std::atomic<std::size_t> Queued { 0 }; // Jobs waiting in any queue.
+    std::mutex SleepLock; // Guards sleeping and shutdown.
+    std::condition_variable WorkReady; // Signalled when work is queued.
+    bool Stopping { false }; // Set when the workers should exit.
+
+    // Take a job from our own queue, or steal one from another.
+    bool TakeJob(std::size_t self, Job& job)
+    {
+        auto count { this->Queues.size() };
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            auto& queue { *this->Queues[(self + i) % count] };
+            std::lock_guard<std::mutex> lock { queue.Lock };
+
+            if (queue.Jobs.empty())
+                continue;
+
+            // Our own work comes from the front, stolen work from the back.
+            if (i == 0)
+            {
+                job = std::move(queue.Jobs.front());
+                queue.Jobs.pop_front();
+            }
+            else
+            {
+                job = std::move(queue.Jobs.back());
+                queue.Jobs.pop_back();
+            }
+
+            this->Queued--;
+            return true;
+        }
+
+        return false;
+    }
+
+    // Body of each worker thread.
+    void Run(std::size_t self)
+    {
+        while (true)
+        {
+            Job job;
+
+            if (this->TakeJob(self, job))
+            {
+                job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock { this->SleepLock };
+
+            this->WorkReady.wait(lock, [this]()
+            {
+                return this->Stopping || this->Queued > 0;
+            });
+
+            if (this->Stopping && this->Queued == 0)
+                break;
+        }
+    }
+
+public:
+    // Construct a pool with the given number of workers, or one per
+    // hardware thread if zero.
+    explicit ThreadPool(std::size_t threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+
+        if (threadCount == 0)
+            threadCount = 1;
+
+        for (std::size_t i = 0; i < threadCount; i++)
+            this->Queues.push_back(std::make_unique<Queue>());
+
+        for (std::size_t i = 0; i < threadCount; i++)
+            this->Workers.emplace_back([this, i]() { this->Run(i); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Destructor. Runs any queued work before returning.
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock { this->SleepLock };
+            this->Stopping = true;
+        }
+
+        this->WorkReady.notify_all();
+
+        for (auto& worker : this->Workers)
+            worker.join();
+    }
+
+    // Get the number of workers.
+    std::size_t Size() const
+    {
+        return this->Workers.size();
+    }
+
+    // Queue the given job on the next worker in turn.
+    void Submit(Job job)
+    {
+        auto& queue { *this->Queues[this->NextQueue++ % this->Queues.size()] };
+
+        // Count the job under the queue lock, so it is counted before any
+        // worker can take it and uncount it.
+        {
+            std::lock_guard<std::mutex> lock { queue.Lock };
+            queue.Jobs.push_back(std::move(job));
+            this->Queued++;
+        }
+
+        // Pass through the sleep lock so that a worker between checking
+        // Queued and going to sleep cannot miss the signal.
+        {
+            std::lock_guard<std::mutex> lock { this->SleepLock };
+        }
+
+        this->WorkReady.notify_one();
+    }
+
+    // Run body(i) for every i in [0, count) across the pool and wait for
+    // all of them. The calling thread helps out while it waits. The first
+    // exception thrown by a body is rethrown here.
+    void ParallelFor(std::size_t count, const std::function<void (std::size_t index)>& body)
+    {
+        if (count == 0)
+            return;
+
+        std::atomic<std::size_t> remaining { count };
+        std::mutex doneLock;
+        std::condition_variable done;
+        std::exception_ptr failure;
+
+        // Spread the jobs over the worker queues; idle workers steal the rest.
+        for (std::size_t i = 0; i < count; i++)
+        {
+            this->Submit([&, i]()
+            {
+                try
+                {
+                    body(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock { doneLock };
+
+                    if (!failure)
+                        failure = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock { doneLock };
+
+                if (--remaining == 0)
+                    done.notify_all();
+            });
+        }
+
+        // Help with queued work rather than sitting idle.
+        Job job;
+
+        while (remaining > 0 && this->TakeJob(0, job))
+            job();
+
+        std::unique_lock<std::mutex> lock { doneLock };
+
+        done.wait(lock, [&remaining]()
+        {
+            return remaining == 0;
+        });
+
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+};
+
+#endif // Foundation42_ThreadPool_H
@@ -0,0 +1,118 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+// Tests for NodeReclaimer with the containers' allocators. Build with
+// ThreadSanitizer to check that no memory resource is shared across threads.
+//
+//     g++ -std=c++17 -fsanitize=thread -I.. NodeReclaimerTests.cpp -o NodeReclaimerTests -lpthread && ./NodeReclaimerTests
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <cstdio>
+#include <memory_resource>
+
+#include "../CompactOrderedMap.h"
+#include "../NodeReclaimer.h"
+#include "../OrderedMap.h"
+#include "../OrderedSet.h"
+#include "../ProbabalisticMap.h"
+
+static_assert(ReclaimableAllocator<std::allocator<int>>::value, "std::allocator is thread-safe");
+static_assert(!ReclaimableAllocator<std::pmr::polymorphic_allocator<int>>::value, "pmr resources may not be");
+
+// Fill and clear the given container repeatedly while the reclaimer runs.
+template <typename Container_t, typename Fill_t>
+static void Churn(Container_t& container, NodeReclaimer& reclaimer, Fill_t fill)
+{
+    container.SetReclaimer(&reclaimer);
+
+    for (int round = 0; round < 50; round++)
+    {
+        fill(container, round);
+        container.Clear();
+    }
+}
+
+// pmr containers on a resource that is not thread-safe must free their
+// nodes on their own thread, even with a background reclaimer attached.
+static void TestPmrFreesSynchronously()
+{
+    NodeReclaimer reclaimer { true, 64 };
+    std::pmr::unsynchronized_pool_resource pool;
+
+    pmr::OrderedMap<int, int> map { &pool };
+    Churn(map, reclaimer, [](auto& map, int round)
+    {
+        for (int i = 0; i < 500; i++)
+            map.Set(i, round);
+    });
+
+    pmr::OrderedSet<int> set { &pool };
+    Churn(set, reclaimer, [](auto& set, int round)
+    {
+        for (int i = 0; i < 500; i++)
+            set.Add(i + round);
+    });
+
+    pmr::ProbabalisticMap<int, int> probabalistic { &pool };
+    Churn(probabalistic, reclaimer, [](auto& map, int round)
+    {
+        for (int i = 0; i < 500; i++)
+            map.Set(i, round);
+    });
+
+    pmr::CompactOrderedMap<int, int> compact { &pool };
+    Churn(compact, reclaimer, [](auto& map, int round)
+    {
+        for (int i = 0; i < 500; i++)
+            map.Set(i, round);
+    });
+
+    assert(reclaimer.Pending() == 0);
+}
+
+// Containers on the global heap still hand their nodes over.
+static void TestHeapDefers()
+{
+    NodeReclaimer reclaimer { false };
+    OrderedMap<int, int> map;
+    map.SetReclaimer(&reclaimer);
+
+    for (int i = 0; i < 500; i++)
+        map.Set(i, i);
+
+    map.Clear();
+    assert(map.Count() == 0);
+    assert(reclaimer.Pending() == 1);
+
+    reclaimer.Drain();
+    assert(reclaimer.Pending() == 0);
+}
+
+int main()
+{
+    TestPmrFreesSynchronously();
+    TestHeapDefers();
+
+    std::printf("NodeReclaimer tests passed\n");
+    return 0;
+}
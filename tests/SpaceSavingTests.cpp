@@ -0,0 +1,111 @@
+/*************************************************************************
+ * 
+ * Foundation42. CONFIDENTIAL
+ * ===========================
+ * 
+ *  Copyright (C) [2013] - [2023] Foundation42.
+ *  All Rights Reserved.
+ * 
+ * NOTICE:  All information contained herein is, and remains
+ * the property of Foundation42. and its suppliers, if any.
+ * The intellectual and technical concepts contained herein are
+ * proprietary to Foundation42. and its suppliers and may be
+ * covered by European, U.S. and/or Foreign Patents, patents in process, and
+ * are protected by trade secret or copyright law.
+ * 
+ * Dissemination of this information or reproduction of this material
+ * is strictly forbidden unless prior written permission is obtained
+ * from an authorized Officer of Foundation42.
+ * 
+*************************************************************************/
+
+// Tests for SpaceSaving and ProbabalisticMap's heavy-hitter tracking.
+//
+//     g++ -std=c++17 -I.. SpaceSavingTests.cpp -o SpaceSavingTests && ./SpaceSavingTests
+
+#include <cstdint>
+#include <functional>
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+#include "../ProbabalisticMap.h"
+#include "../SpaceSaving.h"
+
+// A key that was evicted and comes back must not be undercounted.
+static void TestEvictedKeyNeverUndercounts()
+{
+    SpaceSaving<std::string> summary { 2 };
+
+    for (auto key : { "a", "a", "a", "b", "b", "c" })
+        summary.Record(key);
+
+    summary.Remove("c");
+    summary.Record("b");
+
+    auto top { summary.Top(2) };
+    assert(top.size() == 2);
+
+    for (const auto& entry : top)
+    {
+        if (entry.Key == "b")
+            assert(entry.Count >= 3);
+    }
+}
+
+// Erasing the hottest key must not push cold newcomers above the keys
+// that remain.
+static void TestRemovingHotKeyKeepsFloor()
+{
+    ProbabalisticMap<int, int> map;
+    map.TrackHeavyHitters(8);
+
+    for (int round = 0; round < 1000; round++)
+    {
+        for (int key = 1; key <= 4; key++)
+        {
+            for (int hit = 0; hit < key; hit++)
+                map.Set(key, round);
+        }
+    }
+
+    auto before { map.TopK(1) };
+    assert(before.size() == 1 && before[0].Key == 4);
+
+    map.Erase(4);
+    map.Set(123456, 0);
+
+    auto after { map.TopK(8) };
+    assert(after.size() == 4);
+    assert(after[0].Key == 3);
+    assert(after.back().Key == 123456);
+    assert(after.back().Count == 1 && after.back().Error == 0);
+}
+
+// Copying and merging a tracked map must not record hits.
+static void TestCopyDoesNotRecord()
+{
+    ProbabalisticMap<int, int> source;
+    source.TrackHeavyHitters(4);
+
+    for (int i = 0; i < 10; i++)
+        source.Set(1, i);
+
+    ProbabalisticMap<int, int> target;
+    target.TrackHeavyHitters(4);
+    target << source;
+    target = source;
+
+    assert(target.TopK(4).empty());
+    assert(source.TopK(1)[0].Count == 10);
+}
+
+int main()
+{
+    TestEvictedKeyNeverUndercounts();
+    TestRemovingHotKeyKeepsFloor();
+    TestCopyDoesNotRecord();
+
+    std::printf("SpaceSaving tests passed\n");
+    return 0;
+}